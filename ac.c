@@ -0,0 +1,199 @@
+/***********************************************************
+ Implementation of the Aho-Corasick automaton
+ **********************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ac.h"
+#include "xalloc.h"
+
+/* bytes of transition rows kept for the first states (about the L2 size) */
+#define AC_DENSE_BYTES (1 << 21)
+
+struct chunk_order {
+	const char *qs;
+	int k;
+};
+
+/* order chunk offsets by the chunk text */
+static int
+cmp_chunk(const void *x, const void *y, void *arg)
+{
+	const struct chunk_order *o = arg;
+	return memcmp(o->qs + *(const long long *)x, o->qs + *(const long long *)y, o->k);
+}
+
+/* Next state after reading a character of class c in state s */
+static inline uint32_t
+ac_step(const ac_automaton *a, uint32_t s, unsigned c)
+{
+	for (;;) {
+		if (s < a->ndense) return a->dense[(size_t)s * a->nclass + c];
+		for (uint32_t t = a->child[s], e = t + a->nchild[s]; t < e; t++) {
+			if (a->label[t] == c) return t;
+		}
+		s = a->fail[s];
+	}
+}
+
+/* Build the automaton of the m/k chunks of qs.
+   The chunks are sorted, so that the chunks below a trie state form a
+   range of the sorted order; the trie is then built one depth at a time
+   by splitting each range on the next character, which numbers the
+   states breadth-first with the children of a state consecutive and
+   ordered by character. */
+void
+ac_build(ac_automaton *a, const char *qs, long long m, int k)
+{
+	struct chunk_order order = { qs, k };
+	long long *sorted;
+	uint32_t *lo, *hi, *nlo, *nhi;  /* chunk ranges of this and the next depth */
+	uint32_t nlevel, first, cap;
+	long long nchunks = m / k;
+
+	memset(a, 0, sizeof(*a));
+	a->k = k;
+	a->nchunks = nchunks;
+
+	/* character classes, in byte order so that children stay sorted */
+	a->nclass = 1;
+	for (long long i = 0; i < nchunks * k; i++) a->cls[(unsigned char)qs[i]] = 1;
+	for (int b = 0; b < 256; b++) {
+		if (a->cls[b]) a->cls[b] = a->nclass++;
+	}
+
+	sorted = xrealloc(NULL, (nchunks + 1) * sizeof(long long));
+	for (long long i = 0; i < nchunks; i++) sorted[i] = i * k;
+	qsort_r(sorted, nchunks, sizeof(long long), cmp_chunk, &order);
+
+	lo = xrealloc(NULL, (nchunks + 1) * sizeof(uint32_t));
+	hi = xrealloc(NULL, (nchunks + 1) * sizeof(uint32_t));
+	nlo = xrealloc(NULL, (nchunks + 1) * sizeof(uint32_t));
+	nhi = xrealloc(NULL, (nchunks + 1) * sizeof(uint32_t));
+	a->chunk_leaf = xrealloc(NULL, (nchunks + 1) * sizeof(uint32_t));
+
+	cap = 1024;
+	a->child = xrealloc(NULL, cap * sizeof(uint32_t));
+	a->nchild = xrealloc(NULL, cap * sizeof(uint16_t));
+	a->label = xrealloc(NULL, cap);
+
+	/* the root covers all chunks */
+	a->nstates = 1;
+	a->label[0] = 0;
+	lo[0] = 0;
+	hi[0] = nchunks;
+	nlevel = 1;
+	first = 0;
+
+	for (int d = 0; d < k; d++) {
+		uint32_t nnext = 0;
+
+		for (uint32_t j = 0; j < nlevel; j++) {
+			uint32_t s = first + j, r = lo[j];
+
+			a->child[s] = a->nstates;
+			a->nchild[s] = 0;
+			while (r < hi[j]) {
+				unsigned char c = qs[sorted[r] + d];
+				uint32_t r2 = r + 1;
+
+				while (r2 < hi[j] && (unsigned char)qs[sorted[r2] + d] == c) r2++;
+				if (a->nstates == cap) {
+					cap *= 2;
+					a->child = xrealloc(a->child, cap * sizeof(uint32_t));
+					a->nchild = xrealloc(a->nchild, cap * sizeof(uint16_t));
+					a->label = xrealloc(a->label, cap);
+				}
+				a->label[a->nstates++] = a->cls[c];
+				a->nchild[s]++;
+				nlo[nnext] = r;
+				nhi[nnext++] = r2;
+				r = r2;
+			}
+		}
+
+		uint32_t *t;
+		t = lo; lo = nlo; nlo = t;
+		t = hi; hi = nhi; nhi = t;
+		first += nlevel;
+		nlevel = nnext;
+	}
+
+	/* the states of depth k are the leaves */
+	a->first_leaf = first;
+	for (uint32_t j = 0; j < nlevel; j++) {
+		a->child[first + j] = a->nstates;
+		a->nchild[first + j] = 0;
+		for (uint32_t r = lo[j]; r < hi[j]; r++) a->chunk_leaf[sorted[r] / k] = first + j;
+	}
+	free(sorted);
+	free(lo);
+	free(hi);
+	free(nlo);
+	free(nhi);
+
+	/* failure links and transition rows, in breadth-first order: both only
+	   look at states of smaller depth, which are complete by then */
+	a->fail = xrealloc(NULL, a->nstates * sizeof(uint32_t));
+	a->ndense = AC_DENSE_BYTES / (a->nclass * sizeof(uint32_t));
+	if (a->ndense < 1) a->ndense = 1;
+	if (a->ndense > a->nstates) a->ndense = a->nstates;
+	a->dense = xrealloc(NULL, (size_t)a->ndense * a->nclass * sizeof(uint32_t));
+
+	a->fail[0] = 0;
+	for (uint32_t s = 0; s < a->nstates; s++) {
+		for (uint32_t t = a->child[s], e = t + a->nchild[s]; t < e; t++) {
+			a->fail[t] = s == 0 ? 0 : ac_step(a, a->fail[s], a->label[t]);
+		}
+		if (s < a->ndense) {
+			uint32_t *row = &a->dense[(size_t)s * a->nclass];
+
+			for (int c = 0; c < a->nclass; c++) row[c] = s == 0 ? 0 : ac_step(a, a->fail[s], c);
+			for (uint32_t t = a->child[s], e = t + a->nchild[s]; t < e; t++) row[a->label[t]] = t;
+		}
+	}
+}
+
+/* Return the number of the m/k query chunks that appear in ts, which is
+   the count of -t 0. ts is read once; the scan stops early when every
+   distinct chunk has been found. */
+long long
+ac_match(const ac_automaton *a, const char *ts, long long n)
+{
+	uint32_t first_leaf = a->first_leaf, nleaves = a->nstates - first_leaf;
+	uint32_t s = 0, nfound = 0;
+	char *found = calloc(nleaves + 1, 1);
+	long long count = 0;
+
+	if (!found) {
+		fprintf(stderr, " failed to allocate %u bytes. No memory\n", nleaves);
+		exit(1);
+	}
+
+	for (long long i = 0; i < n && nfound < nleaves; i++) {
+		s = ac_step(a, s, a->cls[(unsigned char)ts[i]]);
+		if (s >= first_leaf && !found[s - first_leaf]) {
+			found[s - first_leaf] = 1;
+			nfound++;
+		}
+	}
+
+	for (long long i = 0; i < a->nchunks; i++) count += found[a->chunk_leaf[i] - first_leaf];
+	free(found);
+	return count;
+}
+
+void
+ac_free(ac_automaton *a)
+{
+	free(a->dense);
+	free(a->child);
+	free(a->nchild);
+	free(a->label);
+	free(a->fail);
+	free(a->chunk_leaf);
+	memset(a, 0, sizeof(*a));
+}
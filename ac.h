@@ -0,0 +1,39 @@
+/***********************************************************
+ File Name: ac.h
+ Description: definition of the Aho-Corasick automaton
+              matching all query chunks in one pass
+ **********************************************************/
+#ifndef AC_H
+#define AC_H
+
+#include <stdint.h>
+
+/* The states are the distinct prefixes of the m/k query chunks (a trie),
+   numbered in breadth-first order. All chunks have length k, so a state
+   of depth k is reached exactly when the last k characters read form a
+   chunk; those leaf states are numbered last.
+   Characters are mapped to dense classes (class 0 for bytes that occur in
+   no chunk). The first ndense states, where the trie branches most, have a
+   full row of transitions; the others keep their children and a failure
+   link, which keeps the table small for large queries. */
+typedef struct {
+	int k;
+	int nclass;            /* number of character classes */
+	uint8_t cls[256];      /* byte -> character class */
+	uint32_t nstates;
+	uint32_t ndense;       /* states with a row in dense */
+	uint32_t first_leaf;   /* states >= first_leaf have depth k */
+	uint32_t *dense;       /* ndense rows of nclass next states */
+	uint32_t *child;       /* first child of each state, children are consecutive */
+	uint16_t *nchild;      /* number of children of each state */
+	uint8_t *label;        /* class of the edge entering each state */
+	uint32_t *fail;        /* longest proper suffix of each state that is a state */
+	long long nchunks;     /* m/k */
+	uint32_t *chunk_leaf;  /* leaf state of each chunk */
+} ac_automaton;
+
+void ac_build(ac_automaton *a, const char *qs, long long m, int k);
+long long ac_match(const ac_automaton *a, const char *ts, long long n);
+void ac_free(ac_automaton *a);
+
+#endif
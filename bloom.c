@@ -3,6 +3,13 @@
  **********************************************************/
 
 
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "bloom.h"
 
 /* Constants for bloom filter implementation */
@@ -10,6 +17,14 @@ const int H1PRIME = 4189793;
 const int H2PRIME = 3296731;
 const int BLOOM_HASH_NUM = 10;
 
+/* size of a block of the BLOOM_BLOCKED layout, one cache line */
+#define BLOOM_BLOCK_BITS 512
+
+/* keys whose probes are in flight at once in bloom_query_batch() */
+#define BLOOM_BATCH 64
+/* huge page size assumed when backing a bitmap with huge pages */
+#define BLOOM_HUGEPAGE_SIZE (2UL << 20)
+
 /* The hash function used by the bloom filter */
 int
 hash_i(int i, /* which of the BLOOM_HASH_NUM hashes to use */ 
@@ -22,31 +37,250 @@ hash_i(int i, /* which of the BLOOM_HASH_NUM hashes to use */
    (each char represents 8 bits)
    Furthermore, clear all bits for the allocated character array. 
    Hint:  use the malloc and bzero library function 
-	 Return value is the newly initialized bloom_filter struct.*/
+	 Return value is the newly initialized bloom_filter struct.
+	 The filter uses BLOOM_HASH_NUM bits per element placed by hash_i(). */
 bloom_filter 
-bloom_init(int bsz /* size of bitmap to allocate in bits*/ )
+bloom_init(long long bsz /* size of bitmap to allocate in bits*/ )
 {
 	bloom_filter f;
 	f.bsz = bsz;
+	f.type = BLOOM_STANDARD;
+	f.nhash = BLOOM_HASH_NUM;
+	f.legacy = 1;
+	f.map = NULL;
+	f.maplen = 0;
 
-	/* your code here*/
-	int size = bsz/8;
+	size_t size = bsz/8;
 	if ((bsz % 8) > 0) size++;
 
 	f.buf = (char *) malloc(size);
+	if (!f.buf) {
+		fprintf(stderr, " failed to allocate %zu bytes. No memory\n", size);
+		exit(1);
+	}
+	bzero(f.buf, size);
+	return f;
+}
+
+/* Initialize a bloom filter of the given type (enum bloom_type). A
+   BLOOM_STANDARD filter is the same as bloom_init(); a BLOOM_BLOCKED one
+   is bloom_init_opt() with BLOOM_HASH_NUM hashes. */
+bloom_filter
+bloom_init_type(long long bsz, /* size of bitmap to allocate in bits*/
+                int type       /* bit layout */)
+{
+	if (type != BLOOM_BLOCKED) return bloom_init(bsz);
+	return bloom_init_opt(bsz, BLOOM_HASH_NUM, type, 0);
+}
+
+/* Initialize a bloom filter setting nhash bits per element, whose bit
+   positions are derived by double hashing from one 64-bit mixed hash of
+   the element, so any 64-bit bsz is usable. A BLOOM_BLOCKED bitmap is
+   rounded up to whole cache-line aligned blocks. With BLOOM_HUGEPAGES in
+   flags the bitmap is backed by huge pages when the system has them (and
+   by transparent huge pages otherwise). */
+bloom_filter
+bloom_init_opt(long long bsz, /* size of bitmap to allocate in bits*/
+               int nhash,     /* bits set per element */
+               int type,      /* bit layout */
+               int flags      /* BLOOM_HUGEPAGES */)
+{
+	bloom_filter f;
+	size_t size;
+
+	if (bsz < 64) bsz = 64;
+	if (type == BLOOM_BLOCKED) {
+		bsz = (bsz + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS * BLOOM_BLOCK_BITS;
+	}
+	if (nhash < 1) nhash = 1;
+	if (nhash > BLOOM_MAX_HASH) nhash = BLOOM_MAX_HASH;
+
+	f.bsz = bsz;
+	f.type = type;
+	f.nhash = nhash;
+	f.legacy = 0;
+	f.map = NULL;
+	f.maplen = 0;
+
+	size = (bsz + 63) / 64 * 8;
+	if ((flags & BLOOM_HUGEPAGES) && size >= BLOOM_HUGEPAGE_SIZE) {
+		size_t maplen = (size + BLOOM_HUGEPAGE_SIZE - 1) / BLOOM_HUGEPAGE_SIZE * BLOOM_HUGEPAGE_SIZE;
+		void *p = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p == MAP_FAILED) {
+			p = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p != MAP_FAILED) madvise(p, maplen, MADV_HUGEPAGE);
+		}
+		if (p != MAP_FAILED) {
+			/* anonymous mappings are zero-filled */
+			f.buf = p;
+			f.map = p;
+			f.maplen = maplen;
+			return f;
+		}
+	}
+
+	void *buf;
+	if (posix_memalign(&buf, BLOOM_BLOCK_BITS / 8, size) != 0) {
+		fprintf(stderr, " failed to allocate %zu bytes. No memory\n", size);
+		exit(1);
+	}
+	f.buf = buf;
 	bzero(f.buf, size);
-	// memset(f.buf, 0, size);
 	return f;
 }
 
+/* Compute the bitmap size and number of hashes minimizing the size of a
+   filter holding n elements with a false positive rate of at most fpr:
+   bsz = -n ln(fpr) / ln(2)^2 and nhash = bsz/n ln(2). */
+void
+bloom_optimal(long long n, double fpr, long long *bsz, int *nhash)
+{
+	double bits;
+	int k;
+
+	if (n < 1) n = 1;
+	if (fpr <= 0 || fpr >= 1) fpr = 0.01;
+
+	bits = ceil(-n * log(fpr) / (M_LN2 * M_LN2));
+	k = (int)lround(bits / n * M_LN2);
+	if (k < 1) k = 1;
+	if (k > BLOOM_MAX_HASH) k = BLOOM_MAX_HASH;
+
+	*bsz = (long long)bits;
+	*nhash = k;
+}
+
+/* Initialize a bloom filter sized by bloom_optimal() for n elements and
+   the target false positive rate fpr (see bloom_init_opt()). */
+bloom_filter
+bloom_init_fpr(long long n, double fpr, int type, int flags)
+{
+	long long bsz;
+	int nhash;
+
+	bloom_optimal(n, fpr, &bsz, &nhash);
+	return bloom_init_opt(bsz, nhash, type, flags);
+}
+
+/* 64-bit finalizer (from splitmix64) used to spread RK hash values, which
+   are all smaller than the RK modulus, over 64 bits */
+static inline uint64_t
+mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* map a 64-bit hash uniformly onto [0, n) without a division */
+static inline uint64_t
+reduce64(uint64_t h, uint64_t n)
+{
+	return (uint64_t)(((unsigned __int128)h * n) >> 64);
+}
+
+/* Double hashing for the standard layout of bloom_init_opt() filters:
+   bit i of elm is reduce64(h1 + i*h2, bsz). */
+static inline void
+std_hashes(long long elm, uint64_t *h1, uint64_t *h2)
+{
+	*h1 = mix64((uint64_t)elm);
+	*h2 = mix64(*h1 ^ 0x9e3779b97f4a7c15ULL) | 1;
+}
+
+static inline uint64_t
+std_bit(bloom_filter f, uint64_t h1, uint64_t h2, int i)
+{
+	return reduce64(h1 + i * h2, f.bsz);
+}
+
+/* First word of the block holding elm. The nhash bit positions inside the
+   block are derived from a second hash by double hashing:
+   pos_i = (h1 + i*h2) mod 512 (see blocked_bit()). */
+static inline uint64_t *
+blocked_block(bloom_filter f, long long elm, uint64_t *h)
+{
+	uint64_t nblocks = f.bsz / BLOOM_BLOCK_BITS;
+	uint64_t x = mix64((uint64_t)elm);
+
+	*h = mix64(x ^ 0x9e3779b97f4a7c15ULL);
+	return (uint64_t *)f.buf + reduce64(x, nblocks) * (BLOOM_BLOCK_BITS / 64);
+}
+
+static inline unsigned
+blocked_bit(uint64_t h, int i)
+{
+	return ((uint32_t)h + i * (uint32_t)((h >> 32) | 1)) >> (32 - 9);
+}
+
+static void
+blocked_add(bloom_filter f, long long elm)
+{
+	uint64_t h, *blk = blocked_block(f, elm, &h);
+
+	for (int i = 0; i < f.nhash; i++) {
+		unsigned pos = blocked_bit(h, i);
+		blk[pos >> 6] |= 1ULL << (pos & 63);
+	}
+}
+
+static int
+blocked_query(bloom_filter f, long long elm)
+{
+	uint64_t h, *blk = blocked_block(f, elm, &h);
+
+	for (int i = 0; i < f.nhash; i++) {
+		unsigned pos = blocked_bit(h, i);
+		if (!(blk[pos >> 6] & (1ULL << (pos & 63)))) return 0;
+	}
+	return 1;
+}
+
+static void
+std_add(bloom_filter f, long long elm)
+{
+	uint64_t h1, h2, *words = (uint64_t *)f.buf;
+
+	std_hashes(elm, &h1, &h2);
+	for (int i = 0; i < f.nhash; i++) {
+		uint64_t pos = std_bit(f, h1, h2, i);
+		words[pos >> 6] |= 1ULL << (pos & 63);
+	}
+}
+
+static int
+std_query(bloom_filter f, long long elm)
+{
+	uint64_t h1, h2, *words = (uint64_t *)f.buf;
+
+	std_hashes(elm, &h1, &h2);
+	for (int i = 0; i < f.nhash; i++) {
+		uint64_t pos = std_bit(f, h1, h2, i);
+		if (!(words[pos >> 6] & (1ULL << (pos & 63)))) return 0;
+	}
+	return 1;
+}
+
 /* Add elm into the given bloom filter*/
 void
 bloom_add(bloom_filter f,
           long long elm /* the element to be added (a RK hash value) */)
 {
-	int hashed = 0, div = 0, rem = 0;
+	long long hashed = 0, div = 0;
+	int rem = 0;
 	char bit;
-	int size = f.bsz;
+	long long size = f.bsz;
+
+	if (f.type == BLOOM_BLOCKED) {
+		blocked_add(f, elm);
+		return;
+	}
+	if (!f.legacy) {
+		std_add(f, elm);
+		return;
+	}
+
 	for (int i = 0; i < BLOOM_HASH_NUM; i++){
 		hashed = hash_i(i, elm) % size;
 		div = hashed/8;
@@ -63,31 +297,120 @@ int
 bloom_query(bloom_filter f,
             long long elm /* the query element */ )
 {	
-	int hashed = 0, div = 0, rem = 0;
-	char bit, shift;
-	int count = 0, size = f.bsz;
+	long long hashed = 0, div = 0;
+	int rem = 0;
+	char bit;
+	long long size = f.bsz;
+
+	if (f.type == BLOOM_BLOCKED) return blocked_query(f, elm);
+	if (!f.legacy) return std_query(f, elm);
+
 	for (int i = 0; i < BLOOM_HASH_NUM; i++){
 		hashed = hash_i(i, elm)%size;
 		div = hashed/8;
 		rem = 7-(hashed%8);
 		bit = 0x1 << rem;
-		if ((bit & f.buf[div])==bit) count++;
-		else{
-			return 0;
+		if ((bit & f.buf[div])!=bit) return 0;
+	}
+
+	return 1;
+}
+
+
+/* bloom_query() for a batch of at most BLOOM_BATCH keys in the standard
+   layout: all bit addresses are computed and prefetched first, so that the
+   cache misses of different keys overlap, then the bits are tested. */
+static void
+standard_query_batch(bloom_filter f, const long long *keys, size_t n, uint8_t *out)
+{
+	long long pos[BLOOM_BATCH][BLOOM_MAX_HASH];
+	long long size = f.bsz;
+
+	for (size_t j = 0; j < n; j++) {
+		if (f.legacy) {
+			/* same values as hash_i() */
+			int h1 = keys[j] % H1PRIME, h2 = keys[j] % H2PRIME;
+			for (int i = 0; i < f.nhash; i++) {
+				pos[j][i] = (h1 + i*h2 + 1 + i*i) % size;
+				__builtin_prefetch(&f.buf[pos[j][i]/8]);
+			}
+		} else {
+			uint64_t h1, h2;
+			std_hashes(keys[j], &h1, &h2);
+			for (int i = 0; i < f.nhash; i++) {
+				pos[j][i] = std_bit(f, h1, h2, i);
+				__builtin_prefetch(&f.buf[pos[j][i]/8]);
+			}
 		}
+	}
 
+	for (size_t j = 0; j < n; j++) {
+		int i;
+		if (f.legacy) {
+			for (i = 0; i < f.nhash; i++) {
+				char bit = 0x1 << (7-(pos[j][i]%8));
+				if ((bit & f.buf[pos[j][i]/8]) != bit) break;
+			}
+		} else {
+			const uint64_t *words = (const uint64_t *)f.buf;
+			for (i = 0; i < f.nhash; i++) {
+				if (!(words[pos[j][i] >> 6] & (1ULL << (pos[j][i] & 63)))) break;
+			}
+		}
+		out[j] = (i == f.nhash);
+	}
+}
 
+/* same for the blocked layout, where there is a single block per key */
+static void
+blocked_query_batch(bloom_filter f, const long long *keys, size_t n, uint8_t *out)
+{
+	uint64_t *blk[BLOOM_BATCH], h[BLOOM_BATCH];
+
+	for (size_t j = 0; j < n; j++) {
+		blk[j] = blocked_block(f, keys[j], &h[j]);
+		__builtin_prefetch(blk[j]);
 	}
 
-	return 1;
+	for (size_t j = 0; j < n; j++) {
+		int hit = 1;
+		for (int i = 0; i < f.nhash; i++) {
+			unsigned pos = blocked_bit(h[j], i);
+			hit &= (blk[j][pos >> 6] >> (pos & 63)) & 1;
+		}
+		out[j] = hit;
+	}
 }
 
+/* Query n keys at once: out[j] is set to bloom_query(f, keys[j]).
+   Keys are processed BLOOM_BATCH at a time with their memory accesses
+   prefetched, which hides DRAM latency once the bitmap outgrows the caches. */
+void
+bloom_query_batch(bloom_filter f, const long long *keys, size_t n, uint8_t *out)
+{
+	for (size_t b = 0; b < n; b += BLOOM_BATCH) {
+		size_t cnt = n - b < BLOOM_BATCH ? n - b : BLOOM_BATCH;
+
+		if (f.type == BLOOM_BLOCKED) {
+			blocked_query_batch(f, keys + b, cnt, out + b);
+		} else {
+			standard_query_batch(f, keys + b, cnt, out + b);
+		}
+	}
+}
 
 void 
 bloom_free(bloom_filter *f)
 {
-	free(f->buf);
-	f->buf = f->bsz = 0;
+	if (f->map) {
+		munmap(f->map, f->maplen);
+	} else {
+		free(f->buf);
+	}
+	f->buf = NULL;
+	f->bsz = 0;
+	f->map = NULL;
+	f->maplen = 0;
 }
 
 /* print out the first count bits in the bloom filter */
@@ -95,7 +418,7 @@ void
 bloom_print(bloom_filter f,
             int count     /* number of bits to display*/ )
 {
-	int i;
+	long long i;
 
 	assert(count % 8 == 0);
 
@@ -106,3 +429,219 @@ bloom_print(bloom_filter f,
 	return;
 }
 
+/* Fraction of the bits of the filter that are set */
+double
+bloom_fill(bloom_filter f)
+{
+	long long set = 0;
+
+	if (f.bsz <= 0) return 0;
+	for (long long i = 0; i < (f.bsz + 7) / 8; i++) set += __builtin_popcount((unsigned char)f.buf[i]);
+	return (double)set / f.bsz;
+}
+
+/* On-disk format of bloom_save(): a header, the bitmap starting on a page
+   boundary (so it can be mapped and used in place) and the caller's extra
+   payload. Integers are stored in host byte order. */
+#define BLOOM_FILE_MAGIC "RKBLOOM"
+#define BLOOM_FILE_VERSION 1
+#define BLOOM_FILE_ALIGN 4096
+
+/* how bit positions are derived from an element */
+#define BLOOM_SCHEME_HASH_I 0 /* hash_i(), bloom_init() filters */
+#define BLOOM_SCHEME_MIX64 1  /* double hashing of mix64(), bloom_init_opt() */
+
+struct bloom_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t hdrsize;     /* sizeof(struct bloom_file_header) */
+	uint32_t type;        /* enum bloom_type */
+	uint32_t scheme;      /* BLOOM_SCHEME_* */
+	uint32_t nhash;
+	int32_t k;
+	int64_t modulus;
+	int64_t bsz;          /* bits */
+	int64_t nelems;
+	uint64_t bitmap_off, bitmap_len;
+	uint64_t extra_off, extra_len;
+	uint64_t checksum;    /* of the header (with checksum 0), bitmap and extra */
+};
+
+/* bytes of bitmap backing f */
+static size_t
+bitmap_bytes(bloom_filter f)
+{
+	if (f.legacy) return (f.bsz + 7) / 8;
+	return (f.bsz + 63) / 64 * 8;
+}
+
+/* FNV-1a over 64-bit words, to detect truncated or corrupted files */
+static uint64_t
+checksum64(uint64_t h, const void *p, size_t n)
+{
+	const unsigned char *c = p;
+	uint64_t w;
+
+	for (; n >= 8; n -= 8, c += 8) {
+		memcpy(&w, c, 8);
+		h = (h ^ w) * 0x100000001b3ULL;
+	}
+	w = 0;
+	if (n) memcpy(&w, c, n);
+	return mix64((h ^ w) * 0x100000001b3ULL);
+}
+
+static uint64_t
+file_checksum(const struct bloom_file_header *hdr, const void *bitmap, const void *extra)
+{
+	struct bloom_file_header h = *hdr;
+	uint64_t sum;
+
+	h.checksum = 0;
+	sum = checksum64(0xcbf29ce484222325ULL, &h, sizeof(h));
+	sum = checksum64(sum, bitmap, hdr->bitmap_len);
+	return checksum64(sum, extra, hdr->extra_len);
+}
+
+/* Write f to fname together with the description meta (whose extra
+   payload may be NULL). The file is written under a temporary name and
+   renamed, so processes mapping an older version keep a consistent view.
+   Return 0 on success, -1 on error. */
+int
+bloom_save(bloom_filter f, const bloom_meta *meta, const char *fname)
+{
+	struct bloom_file_header hdr;
+	static const char zero[BLOOM_FILE_ALIGN];
+	char *tmp;
+	FILE *fp;
+	int ok;
+
+	/* bloom_load() takes no filter without bits */
+	if (f.bsz < 1) {
+		fprintf(stderr, "bloom_save: %s: empty filter\n", fname);
+		return -1;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BLOOM_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = BLOOM_FILE_VERSION;
+	hdr.hdrsize = sizeof(hdr);
+	hdr.type = f.type;
+	hdr.scheme = f.legacy ? BLOOM_SCHEME_HASH_I : BLOOM_SCHEME_MIX64;
+	hdr.nhash = f.nhash;
+	hdr.k = meta->k;
+	hdr.modulus = meta->modulus;
+	hdr.bsz = f.bsz;
+	hdr.nelems = meta->nelems;
+	hdr.bitmap_off = BLOOM_FILE_ALIGN;
+	hdr.bitmap_len = bitmap_bytes(f);
+	hdr.extra_off = (hdr.bitmap_off + hdr.bitmap_len + 7) / 8 * 8;
+	hdr.extra_len = meta->extra ? meta->extra_len : 0;
+	hdr.checksum = file_checksum(&hdr, f.buf, meta->extra);
+
+	tmp = malloc(strlen(fname) + 32);
+	if (!tmp) {
+		fprintf(stderr, "bloom_save: No memory\n");
+		return -1;
+	}
+	sprintf(tmp, "%s.tmp%d", fname, (int)getpid());
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		perror("bloom_save: fopen ");
+		free(tmp);
+		return -1;
+	}
+	ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+	  && fwrite(zero, hdr.bitmap_off - sizeof(hdr), 1, fp) == 1
+	  && fwrite(f.buf, 1, hdr.bitmap_len, fp) == hdr.bitmap_len
+	  && fwrite(zero, 1, hdr.extra_off - hdr.bitmap_off - hdr.bitmap_len, fp)
+	     == hdr.extra_off - hdr.bitmap_off - hdr.bitmap_len
+	  && (hdr.extra_len == 0 || fwrite(meta->extra, 1, hdr.extra_len, fp) == hdr.extra_len);
+	if (fclose(fp) != 0) ok = 0;
+	if (!ok || rename(tmp, fname) != 0) {
+		perror("bloom_save: write ");
+		unlink(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+	return 0;
+}
+
+/* Map the filter file fname written by bloom_save() read-only into f and
+   fill in meta (meta->extra points into the mapping). The pages are shared
+   with every other process using the same file. The filter is released
+   with bloom_free() and must not be added to.
+   Return 0 on success, -1 if the file cannot be read or is not valid. */
+int
+bloom_load(const char *fname, bloom_filter *f, bloom_meta *meta)
+{
+	struct bloom_file_header hdr;
+	struct stat st;
+	char *map;
+	const char *err = NULL;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		perror("bloom_load: open ");
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("bloom_load: fstat ");
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(hdr)) {
+		fprintf(stderr, "bloom_load: %s: not a filter file\n", fname);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("bloom_load: mmap ");
+		return -1;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+
+	if (memcmp(hdr.magic, BLOOM_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+		err = "not a filter file";
+	} else if (hdr.version != BLOOM_FILE_VERSION || hdr.hdrsize != sizeof(hdr)) {
+		err = "unsupported version";
+	} else if (hdr.bitmap_off % BLOOM_FILE_ALIGN || hdr.bitmap_off < sizeof(hdr)
+	           || hdr.bitmap_len > (uint64_t)st.st_size - hdr.bitmap_off
+	           || hdr.extra_off > (uint64_t)st.st_size
+	           || hdr.extra_len > (uint64_t)st.st_size - hdr.extra_off
+	           || (hdr.type != BLOOM_STANDARD && hdr.type != BLOOM_BLOCKED)
+	           || hdr.scheme > BLOOM_SCHEME_MIX64 || hdr.nhash < 1 || hdr.nhash > BLOOM_MAX_HASH
+	           || hdr.bsz < 1) {
+		err = "corrupted header";
+	}
+	if (!err) {
+		f->buf = map + hdr.bitmap_off;
+		f->bsz = hdr.bsz;
+		f->type = hdr.type;
+		f->nhash = hdr.nhash;
+		f->legacy = hdr.scheme == BLOOM_SCHEME_HASH_I;
+		if (bitmap_bytes(*f) != hdr.bitmap_len) {
+			err = "corrupted header";
+		} else if (file_checksum(&hdr, f->buf, map + hdr.extra_off) != hdr.checksum) {
+			err = "checksum mismatch";
+		}
+	}
+	if (err) {
+		fprintf(stderr, "bloom_load: %s: %s\n", fname, err);
+		munmap(map, st.st_size);
+		f->buf = NULL;
+		return -1;
+	}
+
+	f->map = map;
+	f->maplen = st.st_size;
+	meta->k = hdr.k;
+	meta->modulus = hdr.modulus;
+	meta->nelems = hdr.nelems;
+	meta->extra = map + hdr.extra_off;
+	meta->extra_len = hdr.extra_len;
+	return 0;
+}
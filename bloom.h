@@ -2,20 +2,62 @@
  File Name: bloom.h
  Description: definition of Bloom filter functions
  **********************************************************/
+#ifndef BLOOM_H
+#define BLOOM_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+
+/* Bit layouts of the filter. STANDARD spreads the BLOOM_HASH_NUM bits of
+   an element over the whole bitmap; BLOCKED keeps them all inside one
+   64-byte block so that every add/query touches a single cache line. */
+enum bloom_type { BLOOM_STANDARD = 0, BLOOM_BLOCKED };
+
+/* flags for bloom_init_opt() and bloom_init_fpr() */
+#define BLOOM_HUGEPAGES 1
+
+/* upper bound on the number of bits set per element */
+#define BLOOM_MAX_HASH 16
 
 typedef struct {
 	char *buf; /* the bitmap representing the bloom filter*/
-	int bsz; /* size of bitmap in bits*/
+	long long bsz; /* size of bitmap in bits*/
+	int type; /* enum bloom_type */
+	int nhash; /* number of bits set per element */
+	int legacy; /* bits are placed by hash_i() (bloom_init() filters) */
+	char *map; /* start of the mapping holding buf, NULL if buf was malloc'ed */
+	size_t maplen; /* size of that mapping */
 } bloom_filter;
 
-bloom_filter bloom_init(int bsz);
+/* Description of a filter file written by bloom_save(). k and modulus
+   record how the element hashes were computed; extra is an opaque payload
+   stored after the bitmap (rkmatch keeps the query there). */
+typedef struct {
+	int k;               /* chunk length the RK hashes cover */
+	long long modulus;   /* RK modulus */
+	long long nelems;    /* number of elements added */
+	const void *extra;   /* payload, points into the mapping after bloom_load() */
+	long long extra_len; /* size of the payload in bytes */
+} bloom_meta;
+
+bloom_filter bloom_init(long long bsz);
+bloom_filter bloom_init_type(long long bsz, int type);
+bloom_filter bloom_init_opt(long long bsz, int nhash, int type, int flags);
+bloom_filter bloom_init_fpr(long long n, double fpr, int type, int flags);
+void bloom_optimal(long long n, double fpr, long long *bsz, int *nhash);
 void bloom_free(bloom_filter *f);
 
 void bloom_add(bloom_filter f, long long elm);
 int bloom_query(bloom_filter f, long long elm);
+void bloom_query_batch(bloom_filter f, const long long *keys, size_t n, uint8_t *out);
 
 void bloom_print(bloom_filter f, int count);
+double bloom_fill(bloom_filter f);
+
+int bloom_save(bloom_filter f, const bloom_meta *meta, const char *fname);
+int bloom_load(const char *fname, bloom_filter *f, bloom_meta *meta);
+
+#endif
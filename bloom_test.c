@@ -9,9 +9,94 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "bloom.h"
 
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long long
+rand_ll(void)
+{
+	long long rll = (long long) random();
+	return rll << 31 | random();
+}
+
+/* Compare the bit layouts at the same number of bits per key: insert bsz/10
+   random keys, then report the false positive rate and the query throughput
+   over up to 10 times as many random (almost surely absent) keys, both one
+   key at a time and with bloom_query_batch(). The keys are generated up
+   front so that only the queries are timed. */
+static void
+compare_layouts(int bsz, int seed)
+{
+	const char *names[] = { "standard", "blocked", "dbl-hash" };
+	int n_inserted = bsz/10, n_probes = n_inserted*10;
+	long long *probes;
+	uint8_t *out;
+
+	if (n_probes > (1 << 24)) n_probes = 1 << 24;
+	probes = (long long *)malloc(sizeof(long long)*n_probes);
+	out = (uint8_t *)malloc(n_probes);
+
+	/* standard and blocked layouts as used by rkmatch by default, then the
+	   standard layout with 64-bit double hashing and the optimal number of
+	   hashes for 10 bits per key */
+	for (int type = 0; type < 3; type++) {
+		long long opt_bsz;
+		int opt_nhash;
+		bloom_filter bf;
+
+		if (type < 2) {
+			bf = bloom_init_type(bsz, type);
+		} else {
+			bloom_optimal(n_inserted, 0.0082, &opt_bsz, &opt_nhash);
+			bf = bloom_init_opt(bsz, opt_nhash, BLOOM_STANDARD, 0);
+		}
+		int matched = 0, batch_matched = 0;
+		double t, tb;
+
+		srandom(seed);
+		for (int i = 0; i < n_inserted; i++) {
+			bloom_add(bf, rand_ll());
+		}
+		for (int i = 0; i < n_probes; i++) {
+			probes[i] = rand_ll();
+		}
+
+		t = now_sec();
+		for (int i = 0; i < n_probes; i++) {
+			matched += bloom_query(bf, probes[i]);
+		}
+		t = now_sec() - t;
+
+		tb = now_sec();
+		bloom_query_batch(bf, probes, n_probes, out);
+		tb = now_sec() - tb;
+		for (int i = 0; i < n_probes; i++) {
+			batch_matched += out[i];
+		}
+		if (batch_matched != matched) {
+			printf("%s: bloom_query_batch found %d positives, bloom_query %d\n",
+			       names[type], batch_matched, matched);
+			exit(1);
+		}
+
+		printf("%-8s %.1f bits/key false positive %.5f (%d/%d) %.2f Mprobes/s, batched %.2f Mprobes/s\n",
+		       names[type], (double)bf.bsz/n_inserted, (double)matched/n_probes,
+		       matched, n_probes, n_probes/t/1e6, n_probes/tb/1e6);
+		bloom_free(&bf);
+	}
+	free(probes);
+	free(out);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -24,11 +109,15 @@ main(int argc, char **argv)
 	int i;
 
   if(argc < 2) {
-    printf("Usage:\n ./bloom_test <bitmap_size> <random_num_seed>\n");
+    printf("Usage:\n ./bloom_test <bitmap_size> <random_num_seed> [compare]\n");
     exit(1);
   }
 
 	bsz = atoi(argv[1]);
+	if (argc > 3 && strcmp(argv[3], "compare") == 0) {
+		compare_layouts(bsz, atoi(argv[2]));
+		return 0;
+	}
 	if (argc > 2) {
 		srandom(atoi(argv[2]));
 	}
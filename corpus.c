@@ -0,0 +1,201 @@
+/***********************************************************
+ Implementation of document collections and the worker pool
+ **********************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+
+void
+corpus_init(corpus *c)
+{
+	c->names = NULL;
+	c->n = 0;
+	c->cap = 0;
+}
+
+static int
+append(corpus *c, const char *path)
+{
+	if (c->n == c->cap) {
+		int cap = c->cap ? c->cap * 2 : 64;
+		char **names = realloc(c->names, cap * sizeof(char *));
+		if (!names) {
+			fprintf(stderr, "corpus_add: failed to allocate %d names. No memory\n", cap);
+			return -1;
+		}
+		c->names = names;
+		c->cap = cap;
+	}
+	c->names[c->n] = strdup(path);
+	if (!c->names[c->n]) return -1;
+	c->n++;
+	return 0;
+}
+
+static int
+not_hidden(const struct dirent *e)
+{
+	return e->d_name[0] != '.';
+}
+
+/* Add the document 'path' to the corpus. A directory adds every file
+   below it (in sorted order, skipping hidden entries).
+   Return 0 on success, -1 (after printing the reason) on failure. */
+int
+corpus_add(corpus *c, const char *path)
+{
+	struct stat st;
+	struct dirent **ents;
+	int n, ret = 0;
+
+	if (strcmp(path, "-") == 0 || stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		/* not a directory: reading errors are reported when matching */
+		return append(c, path);
+	}
+
+	n = scandir(path, &ents, not_hidden, alphasort);
+	if (n < 0) {
+		perror("corpus_add: scandir ");
+		return -1;
+	}
+	for (int i = 0; i < n; i++) {
+		char *sub;
+		if (ret == 0 && asprintf(&sub, "%s/%s", path, ents[i]->d_name) >= 0) {
+			ret = corpus_add(c, sub);
+			free(sub);
+		}
+		free(ents[i]);
+	}
+	free(ents);
+	return ret;
+}
+
+/* Add every document listed in 'listfile', one path per line */
+int
+corpus_add_list(corpus *c, const char *listfile)
+{
+	FILE *fp = strcmp(listfile, "-") == 0 ? stdin : fopen(listfile, "r");
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int ret = 0;
+
+	if (!fp) {
+		perror("corpus_add_list: fopen ");
+		return -1;
+	}
+	while (ret == 0 && (len = getline(&line, &cap, fp)) >= 0) {
+		while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = 0;
+		if (len > 0) ret = corpus_add(c, line);
+	}
+	free(line);
+	if (fp != stdin) fclose(fp);
+	return ret;
+}
+
+void
+corpus_free(corpus *c)
+{
+	for (int i = 0; i < c->n; i++) free(c->names[i]);
+	free(c->names);
+	corpus_init(c);
+}
+
+struct pool {
+	const corpus *c;
+	corpus_fn fn;
+	corpus_report_fn report;
+	void *arg;
+	pthread_mutex_t lock;
+	int next;             /* next document to hand out */
+	int reported;         /* documents reported so far */
+	int reporting;        /* a worker is calling report */
+	long long *results;
+	void **data;          /* set by fn with each result */
+	char *done;
+};
+
+static void *
+worker(void *arg)
+{
+	struct pool *p = arg;
+
+	for (;;) {
+		long long r;
+		void *data = NULL;
+		int i;
+
+		pthread_mutex_lock(&p->lock);
+		i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		if (i >= p->c->n) break;
+
+		r = p->fn(p->c->names[i], &data, p->arg);
+
+		/* report finished documents in corpus order. One worker at a time
+		   reports, without the lock, so that the others keep taking
+		   documents meanwhile; it goes on while the next document is done,
+		   and those finishing later are reported by whoever finishes them. */
+		pthread_mutex_lock(&p->lock);
+		p->results[i] = r;
+		p->data[i] = data;
+		p->done[i] = 1;
+		if (!p->reporting) {
+			p->reporting = 1;
+			while (p->reported < p->c->n && p->done[p->reported]) {
+				int j = p->reported++;
+
+				pthread_mutex_unlock(&p->lock);
+				p->report(p->c->names[j], p->results[j], p->data[j], p->arg);
+				pthread_mutex_lock(&p->lock);
+			}
+			p->reporting = 0;
+		}
+		pthread_mutex_unlock(&p->lock);
+	}
+	return NULL;
+}
+
+/* Run fn on every document of the corpus using nworkers threads that each
+   take the next unprocessed document. report is called with each result in
+   corpus order as soon as all preceding documents are done, by one worker
+   at a time and outside the lock handing out the documents. */
+void
+corpus_run(const corpus *c, int nworkers, corpus_fn fn,
+           corpus_report_fn report, void *arg)
+{
+	struct pool p = { c, fn, report, arg, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, NULL, NULL, NULL };
+	pthread_t *tids;
+	int t, started;
+
+	if (nworkers > c->n) nworkers = c->n;
+	if (nworkers < 1) nworkers = 1;
+
+	p.results = malloc(c->n * sizeof(long long));
+	p.data = malloc(c->n * sizeof(void *));
+	p.done = calloc(c->n, 1);
+	tids = malloc(nworkers * sizeof(pthread_t));
+	if (!p.results || !p.data || !p.done || !tids) {
+		fprintf(stderr, "corpus_run: failed to allocate results for %d documents. No memory\n", c->n);
+		exit(1);
+	}
+
+	for (started = 1; started < nworkers; started++) {
+		if (pthread_create(&tids[started], NULL, worker, &p) != 0) break;
+	}
+	worker(&p);
+	for (t = 1; t < started; t++) pthread_join(tids[t], NULL);
+
+	free(p.results);
+	free(p.data);
+	free(p.done);
+	free(tids);
+}
@@ -0,0 +1,30 @@
+/***********************************************************
+ File Name: corpus.h
+ Description: definition of document collections and the
+              worker pool matching a query against them
+ **********************************************************/
+#ifndef CORPUS_H
+#define CORPUS_H
+
+typedef struct {
+	char **names; /* paths of the documents */
+	int n;        /* number of documents */
+	int cap;      /* allocated size of names */
+} corpus;
+
+/* per-document work: returns a result for the document fname, and may set
+   *data (NULL before the call) to more results of the document */
+typedef long long (*corpus_fn)(const char *fname, void **data, void *arg);
+/* called once per document, in corpus order, with the results of
+   corpus_fn; it owns data */
+typedef void (*corpus_report_fn)(const char *fname, long long result, void *data, void *arg);
+
+void corpus_init(corpus *c);
+int corpus_add(corpus *c, const char *path);
+int corpus_add_list(corpus *c, const char *listfile);
+void corpus_free(corpus *c);
+
+void corpus_run(const corpus *c, int nworkers, corpus_fn fn,
+                corpus_report_fn report, void *arg);
+
+#endif
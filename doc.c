@@ -0,0 +1,133 @@
+/***********************************************************
+ Implementation of the document loader
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "doc.h"
+#include "normalize.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+/* initial buffer size when reading from a pipe */
+#define DOC_READ_CHUNK (1 << 20)
+
+/* Read fd until end of file into a malloc'ed buffer that doubles in size
+   as needed. Used for pipes, terminals and anything mmap() refuses. */
+static int
+read_all(int fd, document *d)
+{
+	size_t cap = DOC_READ_CHUNK, len = 0;
+	char *buf = malloc(cap);
+
+	while (buf) {
+		ssize_t n;
+
+		if (len == cap) {
+			char *nbuf = realloc(buf, cap * 2);
+			if (!nbuf) break;
+			buf = nbuf;
+			cap *= 2;
+		}
+		n = read(fd, buf + len, cap - len);
+		if (n < 0) {
+			perror("doc_read: read ");
+			free(buf);
+			return -1;
+		}
+		if (n == 0) {
+			d->buf = buf;
+			d->len = len;
+			return 0;
+		}
+		len += n;
+	}
+
+	fprintf(stderr, "doc_read: failed to allocate %zu bytes. No memory\n", cap * 2);
+	free(buf);
+	return -1;
+}
+
+/* Load the content of the file 'fname' ("-" is the standard input) into d.
+   Regular files are mapped copy-on-write and prefaulted, so the document
+   can be normalized in place without a separate read() copy; other files
+   are read into a growing buffer.
+   Return 0 on success, -1 (after printing the reason) on failure. */
+int
+doc_read(const char *fname, document *d)
+{
+	struct stat st;
+	int fd, ret;
+
+	d->buf = NULL;
+	d->len = 0;
+	d->maplen = 0;
+
+	fd = strcmp(fname, "-") == 0 ? STDIN_FILENO : open(fname, O_RDONLY);
+	if (fd < 0) {
+		perror("doc_read: open ");
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		perror("doc_read: fstat ");
+		close(fd);
+		return -1;
+	}
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (p != MAP_FAILED) {
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			d->buf = p;
+			d->len = st.st_size;
+			d->maplen = st.st_size;
+			close(fd);
+			return 0;
+		}
+	}
+
+	ret = read_all(fd, d);
+	if (fd != STDIN_FILENO) close(fd);
+	return ret;
+}
+
+/* Normalize the document in place. For mapped documents the pages past
+   the normalized content are handed back to the kernel right away, so the
+   resident size drops to the normalized length. */
+void
+doc_normalize(document *d)
+{
+	d->len = normalize(d->buf, d->len);
+
+	if (d->maplen) {
+		long page = sysconf(_SC_PAGESIZE);
+		size_t keep = ((size_t)d->len + page - 1) / page * page;
+		if (keep < d->maplen) {
+			madvise(d->buf + keep, d->maplen - keep, MADV_DONTNEED);
+		}
+	}
+}
+
+void
+doc_free(document *d)
+{
+	if (d->maplen) {
+		munmap(d->buf, d->maplen);
+	} else {
+		free(d->buf);
+	}
+	d->buf = NULL;
+	d->len = 0;
+	d->maplen = 0;
+}
@@ -0,0 +1,20 @@
+/***********************************************************
+ File Name: doc.h
+ Description: definition of the document loader
+ **********************************************************/
+#ifndef DOC_H
+#define DOC_H
+
+#include <stddef.h>
+
+typedef struct {
+	char *buf;      /* the document content */
+	long long len;  /* length of the content in bytes */
+	size_t maplen;  /* size of the file mapping, 0 if buf was malloc'ed */
+} document;
+
+int doc_read(const char *fname, document *d);
+void doc_normalize(document *d);
+void doc_free(document *d);
+
+#endif
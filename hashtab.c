@@ -0,0 +1,51 @@
+/***********************************************************
+ Implementation of the open-addressing hash table
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hashtab.h"
+
+/* Create a table for up to n entries. The table has at least twice as many
+   slots as entries so that probe sequences stay short. */
+hashtab
+hashtab_init(long long n)
+{
+	hashtab t;
+	long long size = 16;
+
+	while (size < 2 * n) size <<= 1;
+
+	t.slots = malloc(size * sizeof(hashtab_entry));
+	if (!t.slots) {
+		fprintf(stderr, " failed to allocate %lld hash table slots. No memory\n", size);
+		exit(1);
+	}
+	for (long long i = 0; i < size; i++) t.slots[i].key = HASHTAB_EMPTY;
+	t.mask = size - 1;
+	t.n = 0;
+	return t;
+}
+
+/* Add the entry (key, val). Keys need not be unique. The caller must not
+   add more entries than the table was created for. */
+void
+hashtab_add(hashtab *t, long long key, long long val)
+{
+	long long s = hashtab_home(t, key);
+
+	while (t->slots[s].key != HASHTAB_EMPTY) s = (s + 1) & t->mask;
+	t->slots[s].key = key;
+	t->slots[s].val = val;
+	t->n++;
+}
+
+void
+hashtab_free(hashtab *t)
+{
+	free(t->slots);
+	t->slots = NULL;
+	t->mask = 0;
+	t->n = 0;
+}
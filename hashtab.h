@@ -0,0 +1,38 @@
+/***********************************************************
+ File Name: hashtab.h
+ Description: definition of the open-addressing hash table
+              mapping RK hash values to query chunk offsets
+ **********************************************************/
+#ifndef HASHTAB_H
+#define HASHTAB_H
+
+/* marks an empty slot; RK hash values are never negative */
+#define HASHTAB_EMPTY (-1LL)
+
+typedef struct {
+	long long key; /* RK hash value */
+	long long val; /* offset of the chunk with that hash */
+} hashtab_entry;
+
+typedef struct {
+	hashtab_entry *slots;
+	long long mask;   /* number of slots - 1 (a power of two minus one) */
+	long long n;      /* number of entries */
+} hashtab;
+
+hashtab hashtab_init(long long n);
+void hashtab_add(hashtab *t, long long key, long long val);
+void hashtab_free(hashtab *t);
+
+/* Slot where the probe sequence for key starts. Entries sharing a key (two
+   chunks with the same hash) are found by walking the following slots up
+   to the first empty one:
+     for (s = hashtab_home(t, key); t->slots[s].key != HASHTAB_EMPTY; s = (s+1) & t->mask) */
+static inline long long
+hashtab_home(const hashtab *t, long long key)
+{
+	unsigned long long h = (unsigned long long)key * 0x9e3779b97f4a7c15ULL;
+	return (long long)(h >> 32) & t->mask;
+}
+
+#endif
@@ -0,0 +1,965 @@
+/***********************************************************
+ Implementation of the on-disk k-gram index
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rk.h"
+#include "kindex.h"
+#include "xalloc.h"
+
+/* On-disk format of kindex_save(). After the header come, each at an
+   8-byte aligned offset:
+     docs      ndocs struct kindex_doc
+     names     the document names, each terminated by a NUL
+     dir       2^dir_bits + 1 block numbers: dir[b] is the first block
+               whose first hash >> shift is at least b
+     blocks    nblocks struct kindex_block, one per KINDEX_BLOCK_KEYS
+               consecutive keys (distinct hashes, in increasing order), and
+               one more holding the ends of keys and postings
+     keys      the keys of each block as pairs of varints: the hash minus
+               the previous one of the block (the block's first hash for
+               the first key) and the size of its postings, times 2, plus 1
+               if they start with a skip table
+     postings  the postings of each key by increasing document and offset,
+               as varints: the document minus the previous document, then
+               the offset minus the previous offset in the same document
+               (the offset itself in a new document)
+   The postings of a key found in more than KINDEX_SKIP_DOCS documents
+   start with a skip table: its size in bytes as a varint, then a pair of
+   varints for every KINDEX_SKIP_DOCS-th document, the number of the
+   document before it and the offset of its first posting from the end of
+   the table, each minus that of the previous pair.
+   Integers are stored in host byte order. Only the header is checked when
+   the index is loaded: checking the rest would read the whole index. */
+#define KINDEX_FILE_MAGIC "RKINDEX"
+#define KINDEX_FILE_VERSION 2
+#define KINDEX_FILE_ALIGN 4096
+
+/* largest directory, in bits of the hash */
+#define KINDEX_DIR_MAX_BITS 20
+
+/* keys delta-encoded together, decoded one after the other by a lookup */
+#define KINDEX_BLOCK_KEYS 16
+
+/* documents of a posting list between two entries of its skip table */
+#define KINDEX_SKIP_DOCS 32
+
+/* posting lists counted by kindex_top() between two prunings of its
+   candidates */
+#define KINDEX_TOP_PRUNE 16
+
+struct kindex_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t hdrsize;      /* sizeof(struct kindex_file_header) */
+	int32_t k;
+	int32_t w;
+	int64_t modulus;
+	int64_t ndocs;
+	int64_t nkeys;
+	int64_t npostings;
+	int64_t nblocks;
+	uint32_t dir_bits;
+	uint32_t shift;
+	uint64_t docs_off;
+	uint64_t names_off, names_len;
+	uint64_t dir_off;
+	uint64_t blocks_off;
+	uint64_t keys_off, keys_len;
+	uint64_t postings_off, postings_len;
+	uint64_t checksum;     /* of the header with checksum 0 */
+};
+
+struct kindex_doc {
+	uint64_t name_off;     /* in names */
+	int64_t len;           /* normalized length */
+};
+
+struct kindex_block {
+	int64_t hash;          /* of the first key */
+	uint64_t key_off;      /* of the first key in keys */
+	uint64_t post_off;     /* of the first posting of the first key in postings */
+};
+
+/* FNV-1a, to detect truncated or corrupted headers */
+static uint64_t
+header_checksum(const struct kindex_file_header *hdr)
+{
+	struct kindex_file_header h = *hdr;
+	const unsigned char *c = (const unsigned char *)&h;
+	uint64_t sum = 0xcbf29ce484222325ULL;
+
+	h.checksum = 0;
+	for (size_t i = 0; i < sizeof(h); i++) sum = (sum ^ c[i]) * 0x100000001b3ULL;
+	return sum;
+}
+
+void
+kindex_builder_init(kindex_builder *b, int k, int w)
+{
+	memset(b, 0, sizeof(*b));
+	b->k = k;
+	b->w = w;
+}
+
+/* Add the document name, of normalized length len, with its nfp
+   fingerprints fp. Return its document number. */
+long long
+kindex_builder_add(kindex_builder *b, const char *name, long long len,
+                   const winnow_fp *fp, long long nfp)
+{
+	long long doc = b->ndocs;
+
+	if (b->ndocs == b->capdocs) {
+		b->capdocs = b->capdocs ? 2 * b->capdocs : 64;
+		b->names = xrealloc(b->names, b->capdocs * sizeof(char *));
+		b->lens = xrealloc(b->lens, b->capdocs * sizeof(long long));
+	}
+	b->names[doc] = strdup(name);
+	if (!b->names[doc]) {
+		fprintf(stderr, " failed to allocate %zu bytes. No memory\n", strlen(name));
+		exit(1);
+	}
+	b->lens[doc] = len;
+	b->ndocs++;
+
+	if (b->npost + nfp > b->cappost) {
+		while (b->npost + nfp > b->cappost) b->cappost = b->cappost ? 2 * b->cappost : 1024;
+		b->post = xrealloc(b->post, b->cappost * sizeof(kindex_posting));
+	}
+	for (long long i = 0; i < nfp; i++) b->post[b->npost++] = (kindex_posting){ fp[i].hash, doc, fp[i].pos };
+	b->sorted = 0;
+	return doc;
+}
+
+void
+kindex_builder_free(kindex_builder *b)
+{
+	for (long long i = 0; i < b->ndocs; i++) free(b->names[i]);
+	free(b->names);
+	free(b->lens);
+	free(b->post);
+	memset(b, 0, sizeof(*b));
+}
+
+static int
+cmp_posting(const void *x, const void *y)
+{
+	const kindex_posting *a = x, *b = y;
+
+	if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+	if (a->doc != b->doc) return a->doc < b->doc ? -1 : 1;
+	return a->pos < b->pos ? -1 : a->pos > b->pos;
+}
+
+/* Sort the postings by hash, document and offset */
+static void
+sort_postings(kindex_builder *b)
+{
+	if (!b->sorted) qsort(b->post, b->npost, sizeof(kindex_posting), cmp_posting);
+	b->sorted = 1;
+}
+
+static size_t
+put_varint(unsigned char *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+static uint64_t
+align8(uint64_t off)
+{
+	return (off + 7) / 8 * 8;
+}
+
+static int
+write_at(FILE *fp, uint64_t *at, uint64_t off, const void *p, size_t n)
+{
+	static const char zero[8];
+
+	if (off > *at && fwrite(zero, 1, off - *at, fp) != off - *at) return 0;
+	if (n && fwrite(p, 1, n, fp) != n) return 0;
+	*at = off + n;
+	return 1;
+}
+
+/* the pairs counted by one thread of kindex_builder_pairs(): an open
+   addressing table from a*ndocs+b to the fingerprints a and b share */
+struct pair_job {
+	const kindex_posting *post;
+	long long start, end;  /* postings of the thread, whole hashes */
+	long long ndocs;
+	long long *distinct;   /* fingerprints of each document */
+	long long *keys, *counts;
+	long long mask, n;
+	long long *docs;       /* documents of the current hash */
+	long long capdocs;
+};
+
+/* slot where the probes for key start, as in hashtab_home() */
+static inline long long
+pair_home(long long key, long long mask)
+{
+	return (long long)(((unsigned long long)key * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+static void
+pair_grow(struct pair_job *j)
+{
+	long long size = j->keys ? 2 * (j->mask + 1) : 1024;
+	long long *keys = xrealloc(NULL, size * sizeof(long long));
+	long long *counts = xrealloc(NULL, size * sizeof(long long));
+
+	for (long long s = 0; s < size; s++) keys[s] = -1;
+	for (long long i = 0; j->keys && i <= j->mask; i++) {
+		long long s;
+
+		if (j->keys[i] < 0) continue;
+		for (s = pair_home(j->keys[i], size - 1); keys[s] >= 0; s = (s+1) & (size-1));
+		keys[s] = j->keys[i];
+		counts[s] = j->counts[i];
+	}
+	free(j->keys);
+	free(j->counts);
+	j->keys = keys;
+	j->counts = counts;
+	j->mask = size - 1;
+}
+
+static void
+pair_add(struct pair_job *j, long long key)
+{
+	long long s;
+
+	if (2 * (j->n + 1) > j->mask + 1) pair_grow(j);
+	for (s = pair_home(key, j->mask); j->keys[s] >= 0; s = (s+1) & j->mask) {
+		if (j->keys[s] == key) {
+			j->counts[s]++;
+			return;
+		}
+	}
+	j->keys[s] = key;
+	j->counts[s] = 1;
+	j->n++;
+}
+
+static void *
+pair_thread(void *arg)
+{
+	struct pair_job *j = arg;
+
+	for (long long i = j->start, e; i < j->end; i = e) {
+		long long nd = 0;
+
+		/* the distinct documents holding the hash of post[i] */
+		for (e = i; e < j->end && j->post[e].hash == j->post[i].hash; e++) {
+			if (nd > 0 && j->docs[nd-1] == j->post[e].doc) continue;
+			if (nd == j->capdocs) {
+				j->capdocs = j->capdocs ? 2 * j->capdocs : 64;
+				j->docs = xrealloc(j->docs, j->capdocs * sizeof(long long));
+			}
+			j->docs[nd++] = j->post[e].doc;
+		}
+		for (long long a = 0; a < nd; a++) {
+			__atomic_fetch_add(&j->distinct[j->docs[a]], 1, __ATOMIC_RELAXED);
+			for (long long b = a + 1; b < nd; b++) pair_add(j, j->docs[a] * j->ndocs + j->docs[b]);
+		}
+	}
+	return NULL;
+}
+
+static int
+cmp_pair(const void *x, const void *y)
+{
+	const kindex_pair *a = x, *b = y;
+
+	if (a->a != b->a) return a->a < b->a ? -1 : 1;
+	return a->b < b->b ? -1 : a->b > b->b;
+}
+
+/* Count, for every pair of documents of b that share fingerprints, the
+   distinct fingerprints they share, and the distinct fingerprints of each
+   document into distinct[] (b->ndocs of them). The postings are grouped by
+   hash; the groups are split among nthreads threads, each counting the
+   pairs of the documents of each of its groups into its own table. The
+   work is the number of postings plus that of pairs of documents sharing
+   a fingerprint, whatever the number of documents.
+   Set *out to the pairs, ordered by document numbers, to be freed by the
+   caller, and return their number. */
+long long
+kindex_builder_pairs(kindex_builder *b, int nthreads, long long *distinct, kindex_pair **out)
+{
+	struct pair_job *jobs;
+	kindex_pair *pairs;
+	long long total = 0, n = 0;
+	int t;
+
+	sort_postings(b);
+	for (long long d = 0; d < b->ndocs; d++) distinct[d] = 0;
+	if (nthreads < 1) nthreads = 1;
+	jobs = xrealloc(NULL, nthreads * sizeof(struct pair_job));
+	for (t = 0; t < nthreads; t++) {
+		long long start = t ? jobs[t-1].end : 0, end = b->npost * (t+1) / nthreads;
+
+		/* ranges end between two hashes */
+		if (end < start) end = start;
+		while (end > 0 && end < b->npost && b->post[end].hash == b->post[end-1].hash) end++;
+		jobs[t] = (struct pair_job){ b->post, start, end, b->ndocs, distinct };
+	}
+
+	rk_run_jobs(pair_thread, jobs, sizeof(struct pair_job), nthreads);
+	for (t = 0; t < nthreads; t++) total += jobs[t].n;
+
+	/* a pair may have been counted by several threads */
+	pairs = xrealloc(NULL, (total + 1) * sizeof(kindex_pair));
+	for (t = 0; t < nthreads; t++) {
+		for (long long s = 0; jobs[t].keys && s <= jobs[t].mask; s++) {
+			if (jobs[t].keys[s] < 0) continue;
+			pairs[n++] = (kindex_pair){ jobs[t].keys[s] / b->ndocs, jobs[t].keys[s] % b->ndocs,
+			                            jobs[t].counts[s] };
+		}
+		free(jobs[t].keys);
+		free(jobs[t].counts);
+		free(jobs[t].docs);
+	}
+	qsort(pairs, n, sizeof(kindex_pair), cmp_pair);
+	total = n;
+	n = 0;
+	for (long long i = 0; i < total; i++) {
+		if (n > 0 && pairs[n-1].a == pairs[i].a && pairs[n-1].b == pairs[i].b) {
+			pairs[n-1].shared += pairs[i].shared;
+		} else {
+			pairs[n++] = pairs[i];
+		}
+	}
+
+	free(jobs);
+	*out = pairs;
+	return n;
+}
+
+/* Sort the postings of b and write the index to fname. The file is
+   written under a temporary name and renamed, so processes mapping an
+   older version keep a consistent view.
+   Return 0 on success, -1 on error. */
+int
+kindex_save(kindex_builder *b, const char *fname)
+{
+	struct kindex_file_header hdr;
+	struct kindex_doc *docs;
+	struct kindex_block *blocks;
+	uint64_t *dir;
+	unsigned char *keys, *post, *skips = NULL;
+	size_t skip_cap = 0;
+	char *names, *tmp;
+	uint64_t at = 0;
+	long long nkeys = 0, nblocks;
+	size_t klen = 0, plen = 0, nlen = 0;
+	int bits = 0, modbits = 64 - __builtin_clzll(BIG_PRIME);
+	FILE *fp;
+	int ok;
+
+	sort_postings(b);
+	for (long long i = 0; i < b->npost; i++) nkeys += i == 0 || b->post[i].hash != b->post[i-1].hash;
+	nblocks = (nkeys + KINDEX_BLOCK_KEYS - 1) / KINDEX_BLOCK_KEYS;
+
+	/* directory of about one entry per block */
+	while ((1LL << bits) < nblocks && bits < KINDEX_DIR_MAX_BITS && bits < modbits) bits++;
+
+	docs = xrealloc(NULL, (b->ndocs + 1) * sizeof(*docs));
+	for (long long d = 0; d < b->ndocs; d++) nlen += strlen(b->names[d]) + 1;
+	names = xrealloc(NULL, nlen + 1);
+	nlen = 0;
+	for (long long d = 0; d < b->ndocs; d++) {
+		docs[d].name_off = nlen;
+		docs[d].len = b->lens[d];
+		strcpy(names + nlen, b->names[d]);
+		nlen += strlen(b->names[d]) + 1;
+	}
+
+	blocks = xrealloc(NULL, (nblocks + 1) * sizeof(*blocks));
+	dir = xrealloc(NULL, ((1LL << bits) + 1) * sizeof(*dir));
+	keys = xrealloc(NULL, nkeys * 20 + 1);
+	/* a skip table costs at most 10 bytes per key and 20 per
+	   KINDEX_SKIP_DOCS postings */
+	post = xrealloc(NULL, b->npost * 21 + nkeys * 10 + 1);
+	nkeys = 0;
+	for (long long i = 0, j; i < b->npost; i = j) {
+		long long doc = 0, pos = 0, start = plen, ndocs = 0;
+		long long skip_doc = 0, skip_off = 0;
+		size_t slen = 0;
+		struct kindex_block *blk = &blocks[nkeys / KINDEX_BLOCK_KEYS];
+
+		for (j = i; j < b->npost && b->post[j].hash == b->post[i].hash; j++) {
+			const kindex_posting *p = &b->post[j];
+
+			if (j == i || p->doc != doc) {
+				if (ndocs > 0 && ndocs % KINDEX_SKIP_DOCS == 0) {
+					if (slen + 20 > skip_cap) {
+						skip_cap = 2 * skip_cap + 20 * KINDEX_SKIP_DOCS;
+						skips = xrealloc(skips, skip_cap);
+					}
+					slen += put_varint(skips + slen, doc - skip_doc);
+					slen += put_varint(skips + slen, plen - start - skip_off);
+					skip_doc = doc;
+					skip_off = plen - start;
+				}
+				ndocs++;
+			}
+			plen += put_varint(post + plen, p->doc - doc);
+			plen += put_varint(post + plen, p->doc == doc ? p->pos - pos : p->pos);
+			doc = p->doc;
+			pos = p->pos;
+		}
+		if (slen > 0) {
+			/* the table goes in front of the postings */
+			unsigned char size[10];
+			size_t hlen = put_varint(size, slen);
+
+			memmove(post + start + hlen + slen, post + start, plen - start);
+			memcpy(post + start, size, hlen);
+			memcpy(post + start + hlen, skips, slen);
+			plen += hlen + slen;
+		}
+		if (nkeys % KINDEX_BLOCK_KEYS == 0) {
+			blk->hash = b->post[i].hash;
+			blk->key_off = klen;
+			blk->post_off = start;
+		}
+		klen += put_varint(keys + klen, b->post[i].hash - (nkeys % KINDEX_BLOCK_KEYS ? b->post[i-1].hash : blk->hash));
+		klen += put_varint(keys + klen, (uint64_t)(plen - start) << 1 | (slen > 0));
+		nkeys++;
+	}
+	blocks[nblocks].hash = BIG_PRIME;
+	blocks[nblocks].key_off = klen;
+	blocks[nblocks].post_off = plen;
+	for (long long bk = 0, i = 0; bk <= (1LL << bits); bk++) {
+		while (i < nblocks && (blocks[i].hash >> (modbits - bits)) < bk) i++;
+		dir[bk] = i;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, KINDEX_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = KINDEX_FILE_VERSION;
+	hdr.hdrsize = sizeof(hdr);
+	hdr.k = b->k;
+	hdr.w = b->w;
+	hdr.modulus = BIG_PRIME;
+	hdr.ndocs = b->ndocs;
+	hdr.nkeys = nkeys;
+	hdr.npostings = b->npost;
+	hdr.nblocks = nblocks;
+	hdr.dir_bits = bits;
+	hdr.shift = modbits - bits;
+	hdr.docs_off = KINDEX_FILE_ALIGN;
+	hdr.names_off = align8(hdr.docs_off + b->ndocs * sizeof(*docs));
+	hdr.names_len = nlen;
+	hdr.dir_off = align8(hdr.names_off + nlen);
+	hdr.blocks_off = hdr.dir_off + ((1LL << bits) + 1) * sizeof(*dir);
+	hdr.keys_off = hdr.blocks_off + (nblocks + 1) * sizeof(*blocks);
+	hdr.keys_len = klen;
+	hdr.postings_off = align8(hdr.keys_off + klen);
+	hdr.postings_len = plen;
+	hdr.checksum = header_checksum(&hdr);
+
+	tmp = xrealloc(NULL, strlen(fname) + 32);
+	sprintf(tmp, "%s.tmp%d", fname, (int)getpid());
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		perror("kindex_save: fopen ");
+		ok = 0;
+	} else {
+		ok = write_at(fp, &at, 0, &hdr, sizeof(hdr))
+		  && write_at(fp, &at, hdr.docs_off, docs, b->ndocs * sizeof(*docs))
+		  && write_at(fp, &at, hdr.names_off, names, nlen)
+		  && write_at(fp, &at, hdr.dir_off, dir, ((1LL << bits) + 1) * sizeof(*dir))
+		  && write_at(fp, &at, hdr.blocks_off, blocks, (nblocks + 1) * sizeof(*blocks))
+		  && write_at(fp, &at, hdr.keys_off, keys, klen)
+		  && write_at(fp, &at, hdr.postings_off, post, plen);
+		if (fclose(fp) != 0) ok = 0;
+		if (!ok || rename(tmp, fname) != 0) {
+			perror("kindex_save: write ");
+			unlink(tmp);
+			ok = 0;
+		}
+	}
+
+	free(tmp);
+	free(docs);
+	free(names);
+	free(blocks);
+	free(keys);
+	free(dir);
+	free(post);
+	free(skips);
+	return ok ? 0 : -1;
+}
+
+/* Map the index file fname written by kindex_save() read-only into x.
+   Pages are only read when they are looked up, so loading does not
+   depend on the size of the index.
+   Return 0 on success, -1 if the file cannot be read or is not valid. */
+int
+kindex_load(const char *fname, kindex *x)
+{
+	struct kindex_file_header hdr;
+	struct stat st;
+	uint64_t size;
+	char *map;
+	const char *err = NULL;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		perror("kindex_load: open ");
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		perror("kindex_load: fstat ");
+		close(fd);
+		return -1;
+	}
+	size = st.st_size;
+	if (size < KINDEX_FILE_ALIGN) {
+		fprintf(stderr, "kindex_load: %s: not an index file\n", fname);
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("kindex_load: mmap ");
+		return -1;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+
+	if (memcmp(hdr.magic, KINDEX_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+		err = "not an index file";
+	} else if (hdr.version != KINDEX_FILE_VERSION || hdr.hdrsize != sizeof(hdr)) {
+		err = "unsupported version";
+	} else if (header_checksum(&hdr) != hdr.checksum) {
+		err = "checksum mismatch";
+	} else if (hdr.k < 1 || hdr.w < 1 || hdr.ndocs < 0 || hdr.nkeys < 0 || hdr.nblocks < 0
+	           || hdr.dir_bits > KINDEX_DIR_MAX_BITS || hdr.shift > 63
+	           || hdr.docs_off % 8 || hdr.names_off % 8 || hdr.dir_off % 8 || hdr.blocks_off % 8
+	           || hdr.docs_off + hdr.ndocs * sizeof(struct kindex_doc) > hdr.names_off
+	           || hdr.names_off + hdr.names_len > hdr.dir_off
+	           || hdr.dir_off + ((1ULL << hdr.dir_bits) + 1) * 8 > hdr.blocks_off
+	           || hdr.blocks_off + (hdr.nblocks + 1) * sizeof(struct kindex_block) > hdr.keys_off
+	           || hdr.keys_off + hdr.keys_len > hdr.postings_off
+	           || hdr.postings_off > size || hdr.postings_len > size - hdr.postings_off
+	           || (hdr.names_len && map[hdr.names_off + hdr.names_len - 1] != '\0')) {
+		err = "corrupted header";
+	}
+	if (err) {
+		fprintf(stderr, "kindex_load: %s: %s\n", fname, err);
+		munmap(map, size);
+		return -1;
+	}
+
+	x->k = hdr.k;
+	x->w = hdr.w;
+	x->modulus = hdr.modulus;
+	x->ndocs = hdr.ndocs;
+	x->nkeys = hdr.nkeys;
+	x->nblocks = hdr.nblocks;
+	x->docs = (const struct kindex_doc *)(map + hdr.docs_off);
+	x->names = map + hdr.names_off;
+	x->dir = (const uint64_t *)(map + hdr.dir_off);
+	x->ndir = 1ULL << hdr.dir_bits;
+	x->shift = hdr.shift;
+	x->blocks = (const struct kindex_block *)(map + hdr.blocks_off);
+	x->keys = (const unsigned char *)map + hdr.keys_off;
+	x->keys_len = hdr.keys_len;
+	x->postings = (const unsigned char *)map + hdr.postings_off;
+	x->postings_len = hdr.postings_len;
+	x->map = map;
+	x->maplen = size;
+	return 0;
+}
+
+void
+kindex_free(kindex *x)
+{
+	if (x->map) munmap(x->map, x->maplen);
+	memset(x, 0, sizeof(*x));
+}
+
+const char *
+kindex_doc_name(const kindex *x, long long doc)
+{
+	return x->names + x->docs[doc].name_off;
+}
+
+long long
+kindex_doc_len(const kindex *x, long long doc)
+{
+	return x->docs[doc].len;
+}
+
+static inline int
+get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v)
+{
+	/* most deltas take a single byte */
+	if (*p < end && !(**p & 0x80)) {
+		*v = *(*p)++;
+		return 1;
+	}
+	*v = 0;
+	for (int s = 0; *p < end && s < 64; s += 7) {
+		unsigned char c = *(*p)++;
+
+		*v |= (uint64_t)(c & 0x7f) << s;
+		if (!(c & 0x80)) return 1;
+	}
+	return 0;
+}
+
+/* Decode the next entry of the skip table of it, if any */
+static void
+next_skip(kindex_iter *it)
+{
+	uint64_t d, o;
+
+	if (it->skip < it->skip_end && get_varint(&it->skip, it->skip_end, &d)
+	    && get_varint(&it->skip, it->skip_end, &o)) {
+		it->skip_doc += d;
+		it->skip_off += o;
+	} else {
+		it->skip_doc = LLONG_MAX;
+	}
+}
+
+/* Find the postings of hash: the directory narrows the blocks down to
+   those whose first hash shares the top bits of hash, which are binary
+   searched for the last one starting at or below hash, whose keys are
+   then decoded in turn. Set it to read them with kindex_next() and return
+   1, or return 0 if hash is not in the index. */
+int
+kindex_lookup(const kindex *x, long long hash, kindex_iter *it)
+{
+	uint64_t b = (uint64_t)hash >> x->shift;
+	uint64_t lo, hi;
+	const struct kindex_block *blk;
+	const unsigned char *p, *end;
+	long long h;
+	uint64_t off;
+
+	if (hash < 0 || b >= x->ndir || x->nblocks == 0) return 0;
+	/* the block holding hash is the last one starting at or below it: it
+	   is in [dir[b] - 1, dir[b + 1]) */
+	lo = x->dir[b] ? x->dir[b] - 1 : 0;
+	hi = x->dir[b + 1];
+	if (hi > (uint64_t)x->nblocks) hi = x->nblocks;
+	if (lo >= hi || x->blocks[lo].hash > hash) return 0;
+	while (hi - lo > 1) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (x->blocks[mid].hash <= hash) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	blk = &x->blocks[lo];
+	if (blk->key_off > blk[1].key_off || blk[1].key_off > x->keys_len) return 0;
+
+	p = x->keys + blk->key_off;
+	end = x->keys + blk[1].key_off;
+	h = blk->hash;
+	off = blk->post_off;
+	while (p < end) {
+		uint64_t d, len;
+
+		if (!get_varint(&p, end, &d) || !get_varint(&p, end, &len)) return 0;
+		h += d;
+		if (h > hash) return 0;
+		if (h == hash) {
+			uint64_t size = len >> 1;
+
+			if (off > x->postings_len || size > x->postings_len - off) return 0;
+			it->p = x->postings + off;
+			it->end = it->p + size;
+			it->skip = it->skip_end = it->p;
+			if (len & 1) {
+				uint64_t tlen;
+
+				if (!get_varint(&it->p, it->end, &tlen) || tlen > (uint64_t)(it->end - it->p)) return 0;
+				it->skip = it->p;
+				it->skip_end = it->p += tlen;
+			}
+			it->base = it->p;
+			it->skip_doc = 0;
+			it->skip_off = 0;
+			next_skip(it);
+			it->doc = 0;
+			it->pos = 0;
+			return 1;
+		}
+		off += len >> 1;
+	}
+	return 0;
+}
+
+/* Read the next posting of it into it->doc and it->pos. Return 0 after
+   the last one. Document numbers come from the file: the caller checks
+   them against ndocs. */
+int
+kindex_next(kindex_iter *it)
+{
+	uint64_t d, p;
+
+	if (!get_varint(&it->p, it->end, &d) || !get_varint(&it->p, it->end, &p)) return 0;
+	it->doc += d;
+	it->pos = d ? (long long)p : it->pos + (long long)p;
+	return 1;
+}
+
+/* Skip the postings of it before document doc, as far as its skip table
+   allows: kindex_next() then reads the postings that follow the last
+   entry of the table before doc, or the next posting if that is further.
+   Only the entries past the next one are decoded, each once: documents
+   sought in increasing order cost one pass over the table at most, and
+   nothing when the next entry is not before doc. */
+void
+kindex_seek(kindex_iter *it, long long doc)
+{
+	long long sdoc;
+	uint64_t soff;
+
+	if (it->skip_doc >= doc) return;
+	do {
+		sdoc = it->skip_doc;
+		soff = it->skip_off;
+		next_skip(it);
+	} while (it->skip_doc < doc);
+	if (soff <= (uint64_t)(it->end - it->base) && it->base + soff > it->p) {
+		it->p = it->base + soff;
+		it->doc = sdoc;
+		it->pos = 0;
+	}
+}
+
+static int
+cmp_ll(const void *x, const void *y)
+{
+	long long a = *(const long long *)x, b = *(const long long *)y;
+	return a < b ? -1 : a > b;
+}
+
+/* Set *out to the distinct hashes of the fingerprints of qs (normalized),
+   selected as those of the documents of x, in increasing order, to be
+   freed by the caller. Return their number. */
+long long
+kindex_query_hashes(const kindex *x, const char *qs, long long m, long long **out)
+{
+	winnow_fp *fp;
+	long long nfp = winnow_fingerprints(qs, m, x->k, x->w, &fp), n = 0;
+	long long *h = xrealloc(NULL, (nfp > 0 ? nfp : 1) * sizeof(long long));
+
+	for (long long i = 0; i < nfp; i++) h[i] = fp[i].hash;
+	free(fp);
+	qsort(h, nfp, sizeof(long long), cmp_ll);
+	for (long long i = 0; i < nfp; i++) {
+		if (n == 0 || h[i] != h[n-1]) h[n++] = h[i];
+	}
+	*out = h;
+	return n;
+}
+
+/* state of the counts of kindex_top(): count[d] query hashes found so far
+   in document d, hist[c] documents found c times. theta is the largest
+   count that at least topk documents reach, and above the number of
+   documents counted theta times or more; theta is 1 until above >= topk. */
+struct top_counts {
+	long long *count;
+	long long *hist;
+	long long theta, above;
+	int topk;
+};
+
+static int
+cmp_list_len(const void *x, const void *y)
+{
+	const kindex_iter *a = x, *b = y;
+	ptrdiff_t la = a->end - a->p, lb = b->end - b->p;
+
+	return la < lb ? -1 : la > lb;
+}
+
+/* Count one more query hash in document d and raise theta as far as the
+   counts allow */
+static inline void
+top_count(struct top_counts *t, long long d)
+{
+	long long c = ++t->count[d];
+
+	if (c > 1) t->hist[c-1]--;
+	t->hist[c]++;
+	if (c == t->theta) t->above++;
+	while (t->above - t->hist[t->theta] >= t->topk) t->above -= t->hist[t->theta++];
+}
+
+/* whether hit a ranks below hit b: fewer hashes found, or as many in a
+   later document */
+static inline int
+top_weaker(const kindex_hit *a, const kindex_hit *b)
+{
+	return a->matched < b->matched || (a->matched == b->matched && a->doc > b->doc);
+}
+
+static int
+cmp_hit(const void *x, const void *y)
+{
+	const kindex_hit *a = x, *b = y;
+
+	return top_weaker(b, a) ? -1 : top_weaker(a, b);
+}
+
+/* Restore the order of the heap h of n hits (the weakest at the root)
+   below i */
+static void
+top_sift_down(kindex_hit *h, int n, int i)
+{
+	for (;;) {
+		int c = 2 * i + 1;
+		kindex_hit t;
+
+		if (c >= n) break;
+		if (c + 1 < n && top_weaker(&h[c+1], &h[c])) c++;
+		if (!top_weaker(&h[c], &h[i])) break;
+		t = h[i];
+		h[i] = h[c];
+		h[c] = t;
+		i = c;
+	}
+}
+
+/* Find the topk documents of x in which the most of the nq distinct query
+   hashes (see kindex_query_hashes()) are found, and store them into hits
+   (room for topk), best first, as many hashes in the earlier document
+   first. Documents sharing no hash are left out. Return how many are
+   stored, or -1 if out of memory.
+
+   The posting lists are walked from the shortest to the longest. As long
+   as the remaining lists are as many as the topk-th best count so far,
+   every document found is counted. Past that point a document not found
+   yet cannot make the topk, nor one found c times with c plus the lists
+   left below that count: the longest lists, those of the hashes common to
+   many documents, are only merged with the few candidates left, their
+   skip tables jumping over the documents between them (see
+   kindex_seek()). The counts of the candidates are exact
+   at the end, and the best topk are kept in a heap of topk hits. */
+long long
+kindex_top(const kindex *x, const long long *hashes, long long nq, int topk, kindex_hit *hits)
+{
+	kindex_iter *lists = malloc((nq > 0 ? nq : 1) * sizeof(*lists));
+	struct top_counts t = { calloc(x->ndocs > 0 ? x->ndocs : 1, sizeof(long long)),
+	                        calloc(nq + 2, sizeof(long long)), 1, 0, topk };
+	long long *cand = NULL, ncand = 0, capcand = 0, nl = 0, i, nhits = 0;
+
+	if (!lists || !t.count || !t.hist || topk < 1) {
+		free(lists);
+		free(t.count);
+		free(t.hist);
+		return topk < 1 ? 0 : -1;
+	}
+	for (long long q = 0; q < nq; q++) {
+		nl += kindex_lookup(x, hashes[q], &lists[nl]);
+	}
+	qsort(lists, nl, sizeof(*lists), cmp_list_len);
+
+	/* every document found is a candidate, kept in cand */
+	for (i = 0; i < nl && (t.above < topk || nl - i >= t.theta); i++) {
+		kindex_iter it = lists[i];
+		long long last = -1;
+
+		while (kindex_next(&it)) {
+			if (it.doc == last || it.doc < 0 || it.doc >= x->ndocs) continue;
+			last = it.doc;
+			if (t.count[it.doc] == 0) {
+				if (ncand == capcand) {
+					long long *p;
+
+					capcand = capcand ? 2 * capcand : 1024;
+					p = realloc(cand, capcand * sizeof(long long));
+					if (!p) {
+						free(cand);
+						cand = NULL;
+						ncand = -1;
+						break;
+					}
+					cand = p;
+				}
+				cand[ncand++] = it.doc;
+			}
+			top_count(&t, it.doc);
+		}
+		if (ncand < 0) break;
+	}
+
+	if (ncand >= 0) {
+		qsort(cand, ncand, sizeof(long long), cmp_ll);
+		/* only the candidates that can still reach theta are counted; those
+		   that cannot are dropped every KINDEX_TOP_PRUNE lists */
+		for (long long i0 = i; i < nl; i++) {
+			kindex_iter it = lists[i];
+			long long last = -1, n = 0, j = 0;
+
+			if ((i - i0) % KINDEX_TOP_PRUNE == 0) {
+				for (long long c = 0; c < ncand; c++) {
+					if (t.count[cand[c]] + (nl - i) >= t.theta) cand[n++] = cand[c];
+				}
+				ncand = n;
+			}
+			while (j < ncand) {
+				kindex_seek(&it, cand[j]);
+				if (!kindex_next(&it)) break;
+				if (it.doc == last) continue;
+				last = it.doc;
+				while (j < ncand && cand[j] < it.doc) j++;
+				if (j < ncand && cand[j] == it.doc) top_count(&t, cand[j++]);
+			}
+		}
+
+		for (long long c = 0; c < ncand; c++) {
+			kindex_hit h = { cand[c], t.count[cand[c]] };
+
+			if (nhits < topk) {
+				/* sift up */
+				long long at = nhits++;
+
+				while (at > 0 && top_weaker(&h, &hits[(at-1)/2])) {
+					hits[at] = hits[(at-1)/2];
+					at = (at-1)/2;
+				}
+				hits[at] = h;
+			} else if (top_weaker(&hits[0], &h)) {
+				hits[0] = h;
+				top_sift_down(hits, nhits, 0);
+			}
+		}
+		qsort(hits, nhits, sizeof(kindex_hit), cmp_hit);
+	}
+
+	free(cand);
+	free(lists);
+	free(t.count);
+	free(t.hist);
+	return ncand < 0 ? -1 : nhits;
+}
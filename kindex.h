@@ -0,0 +1,95 @@
+/***********************************************************
+ File Name: kindex.h
+ Description: definition of the on-disk k-gram index of a
+              corpus (fingerprint hash -> document postings)
+ **********************************************************/
+#ifndef KINDEX_H
+#define KINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "winnow.h"
+
+/* one occurrence of a fingerprint in the corpus */
+typedef struct {
+	long long hash;   /* RK hash of the k-gram */
+	long long doc;    /* document number, in the order of indexing */
+	long long pos;    /* offset of the k-gram in the normalized document */
+} kindex_posting;
+
+/* an index being built in memory (see kindex_save()) */
+typedef struct {
+	int k;
+	int w;                 /* winnowing window */
+	kindex_posting *post;
+	long long npost, cappost;
+	char **names;          /* document names */
+	long long *lens;       /* normalized document lengths */
+	long long ndocs, capdocs;
+	int sorted;            /* post is ordered by hash, document and offset */
+} kindex_builder;
+
+/* two documents sharing fingerprints (see kindex_builder_pairs()) */
+typedef struct {
+	long long a, b;        /* document numbers, a < b */
+	long long shared;      /* distinct fingerprints of both */
+} kindex_pair;
+
+/* an index file mapped by kindex_load() */
+typedef struct {
+	int k;
+	int w;
+	long long modulus;     /* RK modulus of the hashes */
+	long long ndocs;
+	long long nkeys;       /* distinct hashes */
+	const struct kindex_doc *docs;
+	const char *names;
+	long long nblocks;
+	const uint64_t *dir;   /* first block of each range of hash >> shift */
+	uint64_t ndir;         /* number of ranges */
+	int shift;
+	const struct kindex_block *blocks;
+	const unsigned char *keys;
+	uint64_t keys_len;
+	const unsigned char *postings;
+	uint64_t postings_len;
+	char *map;
+	size_t maplen;
+} kindex;
+
+/* a document of the result of kindex_top() */
+typedef struct {
+	long long doc;
+	long long matched;     /* query hashes found in it */
+} kindex_hit;
+
+/* the postings of one hash, read with kindex_next() */
+typedef struct {
+	const unsigned char *p, *end;
+	long long doc;
+	long long pos;
+	const unsigned char *base;            /* first posting */
+	const unsigned char *skip, *skip_end; /* skip table entries after the next one */
+	long long skip_doc;                   /* of the next entry, LLONG_MAX if none */
+	uint64_t skip_off;
+} kindex_iter;
+
+void kindex_builder_init(kindex_builder *b, int k, int w);
+long long kindex_builder_add(kindex_builder *b, const char *name, long long len,
+                             const winnow_fp *fp, long long nfp);
+int kindex_save(kindex_builder *b, const char *fname);
+long long kindex_builder_pairs(kindex_builder *b, int nthreads, long long *distinct, kindex_pair **out);
+void kindex_builder_free(kindex_builder *b);
+
+int kindex_load(const char *fname, kindex *x);
+void kindex_free(kindex *x);
+const char *kindex_doc_name(const kindex *x, long long doc);
+long long kindex_doc_len(const kindex *x, long long doc);
+int kindex_lookup(const kindex *x, long long hash, kindex_iter *it);
+int kindex_next(kindex_iter *it);
+void kindex_seek(kindex_iter *it, long long doc);
+long long kindex_query_hashes(const kindex *x, const char *qs, long long m, long long **out);
+long long kindex_top(const kindex *x, const long long *hashes, long long nq, int topk, kindex_hit *hits);
+
+#endif
@@ -0,0 +1,140 @@
+/***********************************************************
+ Implementation of bottom-s MinHash sketches
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rk.h"
+#include "minhash.h"
+#include "xalloc.h"
+
+/* k-gram positions hashed at a time */
+#define MINHASH_BLOCK (1 << 16)
+
+/* Value of a k-gram: its RK hash through the splitmix64 finalizer, so that
+   the smallest values are a uniform sample of the k-grams (RK hashes are
+   all below the modulus and not spread over 64 bits) */
+static inline uint64_t
+value(long long h)
+{
+	uint64_t x = (uint64_t)h;
+
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static int
+cmp_u64(const void *x, const void *y)
+{
+	uint64_t a = *(const uint64_t *)x, b = *(const uint64_t *)y;
+	return a < b ? -1 : a > b;
+}
+
+/* Sort the n values of v, drop the repeated ones and keep at most size of
+   them. Return how many are kept. */
+static int
+keep_smallest(uint64_t *v, long long n, int size)
+{
+	long long len = 0;
+
+	qsort(v, n, sizeof(uint64_t), cmp_u64);
+	for (long long i = 0; i < n && len < size; i++) {
+		if (len == 0 || v[i] != v[len-1]) v[len++] = v[i];
+	}
+	return len;
+}
+
+/* Sketch the k-grams of ts. The values below the largest one kept so far
+   are collected in a buffer of twice the sketch size, which is cut back to
+   the size smallest distinct ones when full; past the start of the
+   document almost every value is above that bound and costs a single
+   comparison. */
+void
+minhash_build(minhash *s, const char *ts, long long n, int k, int size)
+{
+	long long npos = n - k + 1, len = 0;
+	uint64_t bound = UINT64_MAX;   /* values above it are not kept */
+	long long *h;
+
+	if (size < 1) size = 1;
+	s->k = k;
+	s->size = size;
+	s->v = xrealloc(NULL, 2 * (size_t)size * sizeof(uint64_t));
+	h = xrealloc(NULL, MINHASH_BLOCK * sizeof(long long));
+
+	for (long long b = 0; b < npos; b += MINHASH_BLOCK) {
+		long long cnt = npos - b < MINHASH_BLOCK ? npos - b : MINHASH_BLOCK;
+
+		rk_hash_positions(k, ts + b, cnt + k - 1, h);
+		for (long long i = 0; i < cnt; i++) {
+			uint64_t x = value(h[i]);
+
+			if (x > bound) continue;
+			s->v[len++] = x;
+			if (len == 2 * size) {
+				len = keep_smallest(s->v, len, size);
+				if (len == size) bound = s->v[size-1];
+			}
+		}
+	}
+	s->len = keep_smallest(s->v, len, size);
+
+	free(h);
+}
+
+/* Estimate the Jaccard similarity of the k-grams of the two documents:
+   of the smallest values of the union of their k-grams (as many as the
+   smaller sketch holds), the share that both documents have. These are
+   the smallest values of the two sketches merged, and a value that is in
+   both documents is in both sketches. Exact when both sketches are. */
+double
+minhash_jaccard(const minhash *a, const minhash *b)
+{
+	int size = a->size < b->size ? a->size : b->size;
+	int i = 0, j = 0, taken = 0, both = 0;
+
+	while (taken < size && (i < a->len || j < b->len)) {
+		if (j == b->len || (i < a->len && a->v[i] < b->v[j])) {
+			i++;
+		} else if (i == a->len || b->v[j] < a->v[i]) {
+			j++;
+		} else {
+			both++;
+			i++;
+			j++;
+		}
+		taken++;
+	}
+	return taken ? (double)both / taken : 0;
+}
+
+/* Estimate the share of the distinct k-grams of a that are k-grams of b.
+   Below the largest value of b's sketch, b's sketch holds every value of
+   b, so the values of a's sketch in that range are a sample of a whose
+   membership in b is known exactly. Its size is stored in *samples unless
+   samples is NULL: it is small when b has many more k-grams than a. */
+double
+minhash_containment(const minhash *a, const minhash *b, int *samples)
+{
+	uint64_t bound = b->len == b->size ? b->v[b->len-1] : UINT64_MAX;
+	int j = 0, sample = 0, both = 0;
+
+	for (int i = 0; i < a->len && a->v[i] <= bound; i++) {
+		while (j < b->len && b->v[j] < a->v[i]) j++;
+		sample++;
+		both += j < b->len && b->v[j] == a->v[i];
+	}
+	if (samples) *samples = sample;
+	return sample ? (double)both / sample : 0;
+}
+
+void
+minhash_free(minhash *s)
+{
+	free(s->v);
+	s->v = NULL;
+	s->len = 0;
+}
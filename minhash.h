@@ -0,0 +1,27 @@
+/***********************************************************
+ File Name: minhash.h
+ Description: definition of bottom-s MinHash sketches, fixed
+              size summaries of the k-grams of a document
+ **********************************************************/
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <stdint.h>
+
+/* The size smallest distinct values of the k-grams of a document, each
+   k-gram valued by its RK hash scrambled over 64 bits. A document with
+   fewer distinct k-grams keeps them all (len < size), and its sketch is
+   exact. */
+typedef struct {
+	int k;
+	int size;
+	int len;
+	uint64_t *v;      /* by increasing value */
+} minhash;
+
+void minhash_build(minhash *s, const char *ts, long long n, int k, int size);
+double minhash_jaccard(const minhash *a, const minhash *b);
+double minhash_containment(const minhash *a, const minhash *b, int *samples);
+void minhash_free(minhash *s);
+
+#endif
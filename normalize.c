@@ -0,0 +1,274 @@
+/***********************************************************
+ Implementation of document normalization
+ **********************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "normalize.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NORMALIZE_X86 1
+#endif
+
+/* same set of characters as isspace() in the C locale */
+static inline int
+is_space(unsigned char c)
+{
+	return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+/* Normalize buf[i..len) given that o bytes of output have been written so
+   far and prev tells whether the last byte consumed was white-space.
+   The loop is branch free: every byte is written to buf[o], and the write
+   cursor only advances if the byte is not a repeated space. */
+static inline long long
+normalize_tail(char *buf, long long i, long long len, long long o, int prev)
+{
+	for (; i < len; i++) {
+		unsigned char c = buf[i];
+		int sp = is_space(c);
+		if ((unsigned char)(c - 'A') < 26) c += 'a' - 'A';
+		buf[o] = sp ? ' ' : c;
+		o += !(sp & prev);
+		prev = sp;
+	}
+
+	/* drop the trailing space, if any */
+	if (o > 0 && prev) o--;
+	return o;
+}
+
+/* Append a block of already case-folded bytes (white-space turned into ' ')
+   whose white-space positions are given by the bits of mask */
+static inline long long
+emit_block(char *buf, long long o, int *prev, const unsigned char *blk, int bsz, uint32_t mask)
+{
+	int p = *prev;
+	for (int j = 0; j < bsz; j++) {
+		int sp = (mask >> j) & 1;
+		buf[o] = blk[j];
+		o += !(sp & p);
+		p = sp;
+	}
+	*prev = p;
+	return o;
+}
+
+long long
+normalize_scalar(char *buf, long long len)
+{
+	/* prev starts as 1 so that leading white-space is dropped */
+	return normalize_tail(buf, 0, len, 0, 1);
+}
+
+#ifdef NORMALIZE_X86
+
+/* The SIMD kernels classify a block of 16/32 bytes at once.  Blocks without
+   white-space (the common case for text) are case folded and stored in one
+   go, blocks made only of white-space collapse into at most one space, and
+   mixed blocks are compacted with a per-byte loop (SSE2) or with a shuffle
+   table over 8-byte groups (AVX2).
+   Writing in place is safe since the write cursor never passes the read
+   cursor and the whole block is loaded before anything is stored. */
+
+static long long
+normalize_sse2(char *buf, long long len)
+{
+	const __m128i upper_lo = _mm_set1_epi8((char)(128 - 'A'));
+	const __m128i upper_n = _mm_set1_epi8((char)(-128 + 26));
+	const __m128i ctrl_lo = _mm_set1_epi8((char)(128 - '\t'));
+	const __m128i ctrl_n = _mm_set1_epi8((char)(-128 + ('\r' - '\t' + 1)));
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	unsigned char blk[16];
+	long long i = 0, o = 0;
+	int prev = 1;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i up = _mm_cmpgt_epi8(upper_n, _mm_add_epi8(v, upper_lo));
+		__m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+		                          _mm_cmpgt_epi8(ctrl_n, _mm_add_epi8(v, ctrl_lo)));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(sp);
+
+		v = _mm_or_si128(v, _mm_and_si128(up, case_bit));
+		if (mask == 0) {
+			_mm_storeu_si128((__m128i *)(buf + o), v);
+			o += 16;
+			prev = 0;
+		} else if (mask == 0xffff) {
+			if (!prev) buf[o++] = ' ';
+			prev = 1;
+		} else {
+			v = _mm_or_si128(_mm_andnot_si128(sp, v), _mm_and_si128(sp, space));
+			_mm_storeu_si128((__m128i *)blk, v);
+			o = emit_block(buf, o, &prev, blk, 16, mask);
+		}
+	}
+	return normalize_tail(buf, i, len, o, prev);
+}
+
+/* pack_table[m] lists the positions of the bits set in m, i.e. the pshufb
+   control that moves the kept bytes of an 8-byte group to its front.
+   Built once, by the first thread asking for the avx2 kernel. */
+static unsigned char pack_table[256][8];
+static pthread_once_t pack_once = PTHREAD_ONCE_INIT;
+
+static void
+init_pack_table(void)
+{
+	for (int m = 0; m < 256; m++) {
+		int n = 0;
+		for (int j = 0; j < 8; j++) {
+			if (m & (1 << j)) pack_table[m][n++] = j;
+		}
+		while (n < 8) pack_table[m][n++] = 0x80;
+	}
+}
+
+__attribute__((target("avx2")))
+static long long
+normalize_avx2(char *buf, long long len)
+{
+	const __m256i upper_lo = _mm256_set1_epi8((char)(128 - 'A'));
+	const __m256i upper_n = _mm256_set1_epi8((char)(-128 + 26));
+	const __m256i ctrl_lo = _mm256_set1_epi8((char)(128 - '\t'));
+	const __m256i ctrl_n = _mm256_set1_epi8((char)(-128 + ('\r' - '\t' + 1)));
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i case_bit = _mm256_set1_epi8(0x20);
+	unsigned char blk[32];
+	long long i = 0, o = 0;
+	int prev = 1;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i up = _mm256_cmpgt_epi8(upper_n, _mm256_add_epi8(v, upper_lo));
+		__m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+		                             _mm256_cmpgt_epi8(ctrl_n, _mm256_add_epi8(v, ctrl_lo)));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(sp);
+
+		v = _mm256_or_si256(v, _mm256_and_si256(up, case_bit));
+		if (mask == 0) {
+			_mm256_storeu_si256((__m256i *)(buf + o), v);
+			o += 32;
+			prev = 0;
+		} else if (mask == 0xffffffffu) {
+			if (!prev) buf[o++] = ' ';
+			prev = 1;
+		} else {
+			/* a space is dropped if the byte before it is white-space too */
+			uint32_t keep = ~(mask & ((mask << 1) | prev));
+
+			v = _mm256_blendv_epi8(v, space, sp);
+			_mm256_storeu_si256((__m256i *)blk, v);
+			for (int g = 0; g < 32; g += 8) {
+				uint8_t k8 = keep >> g;
+				__m128i b = _mm_loadl_epi64((const __m128i *)(blk + g));
+				b = _mm_shuffle_epi8(b, _mm_loadl_epi64((const __m128i *)pack_table[k8]));
+				_mm_storel_epi64((__m128i *)(buf + o), b);
+				o += __builtin_popcount(k8);
+			}
+			prev = mask >> 31;
+		}
+	}
+	return normalize_tail(buf, i, len, o, prev);
+}
+
+#endif /* NORMALIZE_X86 */
+
+/* the kernel of normalize(), set once by pick_best() */
+static normalize_fn best;
+static pthread_once_t best_once = PTHREAD_ONCE_INIT;
+
+static void
+pick_best(void)
+{
+	normalize_fn fn = normalize_kernel("avx2");
+	if (!fn) fn = normalize_kernel("sse2");
+	if (!fn) fn = normalize_scalar;
+	best = fn;
+}
+
+/* Pick the kernel of normalize() and build its tables. normalize() does
+   so on its first call, whichever thread makes it; calling this first
+   keeps the setup out of the threads. */
+void
+normalize_init(void)
+{
+	pthread_once(&best_once, pick_best);
+}
+
+normalize_fn
+normalize_kernel(const char *name)
+{
+	if (strcmp(name, "scalar") == 0) return normalize_scalar;
+#ifdef NORMALIZE_X86
+	if (strcmp(name, "sse2") == 0) return normalize_sse2;
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		pthread_once(&pack_once, init_pack_table);
+		return normalize_avx2;
+	}
+#endif
+	return NULL;
+}
+
+/* The normalize procedure examines a character array of size len
+	 in ONE PASS and does the following:
+	 1) turn all upper case letters into lower case ones
+	 2) turn any white-space character into a space character and,
+	    shrink any n>1 consecutive spaces into exactly 1 space only
+	 3) remove white-space at the beginning and end of the text
+	 The normalization is done IN PLACE so that when the procedure
+	 returns, the character array buf contains the normalized string and
+	 the return value is the length of the normalized string.
+	 The fastest kernel supported by the CPU is picked on the first call
+	 (see normalize_init()).
+*/
+long long
+normalize(char *buf,	/* The character array containing the string to be normalized*/
+					long long len	/* the size of the original character array */)
+{
+	normalize_init();
+	return best(buf, len);
+}
+
+void
+normalize_stream_init(normalize_state *st)
+{
+	st->started = 0;
+	st->pending = 0;
+}
+
+/* Incrementally normalize a document that arrives in pieces. Normalizes
+   in[0..n) into out (which must have room for n+1 bytes) and returns the
+   number of bytes written. Concatenating the output of successive calls
+   gives exactly normalize() of the concatenated input: a space separating
+   two pieces is held back in st until a non-space byte follows, so the
+   trailing white-space of the document is never emitted. */
+long long
+normalize_stream(normalize_state *st, const char *in, long long n, char *out)
+{
+	int lead;
+	long long len;
+
+	if (n == 0) return 0;
+
+	/* a space is owed before this piece's first word if the text so far
+	   ended in white-space or this piece starts with it */
+	lead = st->started && (st->pending || is_space(in[0]));
+
+	memcpy(out + lead, in, n);
+	len = normalize(out + lead, n);
+	if (len == 0) {
+		st->pending = lead;
+		return 0;
+	}
+
+	if (lead) out[0] = ' ';
+	st->started = 1;
+	st->pending = is_space(in[n-1]);
+	return len + lead;
+}
@@ -0,0 +1,28 @@
+/***********************************************************
+ File Name: normalize.h
+ Description: definition of document normalization functions
+ **********************************************************/
+#ifndef NORMALIZE_H
+#define NORMALIZE_H
+
+typedef long long (*normalize_fn)(char *buf, long long len);
+
+/* state carried between the pieces of a streamed document */
+typedef struct {
+	int started; /* some non-space byte has been emitted */
+	int pending; /* a space is owed before the next non-space byte */
+} normalize_state;
+
+long long normalize(char *buf, long long len);
+void normalize_init(void);
+
+void normalize_stream_init(normalize_state *st);
+long long normalize_stream(normalize_state *st, const char *in, long long n, char *out);
+
+/* Individual normalization kernels, exposed for testing and benchmarking.
+   normalize_kernel() returns NULL if the named kernel ("scalar", "sse2",
+   "avx2") is not supported on this machine. */
+long long normalize_scalar(char *buf, long long len);
+normalize_fn normalize_kernel(const char *name);
+
+#endif
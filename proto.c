@@ -0,0 +1,160 @@
+/***********************************************************
+ Implementation of the framed protocol of rkserve
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "proto.h"
+
+/* pending connections of the listening socket */
+#define PROTO_BACKLOG 128
+
+static int
+set_addr(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/* Listen on the UNIX socket path, replacing a stale socket file left there.
+   Return the socket, or -1 (after printing the reason) on failure. */
+int
+proto_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (set_addr(&addr, path) != 0) return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("proto_listen: socket ");
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, PROTO_BACKLOG) != 0) {
+		perror("proto_listen: bind ");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Connect to the server listening on path. Return the socket, or -1
+   (after printing the reason) on failure. */
+int
+proto_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (set_addr(&addr, path) != 0) return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("proto_connect: socket ");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		perror("proto_connect: connect ");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Send a frame of the header hdr and the body. A peer that went away is
+   an error, not a SIGPIPE. Return 0 on success, -1 on failure. */
+int
+proto_send(int fd, const void *hdr, size_t hlen, const char *body, size_t blen)
+{
+	uint32_t len = hlen + blen;
+	struct iovec iov[3] = {
+		{ &len, sizeof(len) }, { (void *)hdr, hlen }, { (void *)body, blen }
+	};
+	struct msghdr msg = { 0 };
+	int i = 0;
+
+	if (hlen + blen > PROTO_MAX_FRAME) {
+		fprintf(stderr, "proto_send: frame of %zu bytes too large\n", hlen + blen);
+		return -1;
+	}
+	while (i < 3) {
+		ssize_t n;
+
+		msg.msg_iov = iov + i;
+		msg.msg_iovlen = 3 - i;
+		n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		/* skip what was sent */
+		for (; i < 3 && (size_t)n >= iov[i].iov_len; i++) n -= iov[i].iov_len;
+		if (i < 3) {
+			iov[i].iov_base = (char *)iov[i].iov_base + n;
+			iov[i].iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+/* Read exactly len bytes. Return 0, 1 at end of file before the first
+   byte, or -1 on failure or end of file in the middle. */
+static int
+read_full(int fd, void *buf, size_t len)
+{
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n = read(fd, (char *)buf + got, len - got);
+
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return n == 0 && got == 0 ? 1 : -1;
+		got += n;
+	}
+	return 0;
+}
+
+/* Receive a frame: its header into hdr (hlen bytes) and its body into
+   *body, malloc'ed and NUL-terminated, to be freed by the caller.
+   Return 0 on success, 1 if the peer closed the connection between two
+   frames, -1 on failure. */
+int
+proto_recv(int fd, void *hdr, size_t hlen, char **body, size_t *blen)
+{
+	uint32_t len;
+	int ret;
+
+	*body = NULL;
+	*blen = 0;
+	ret = read_full(fd, &len, sizeof(len));
+	if (ret != 0) return ret;
+	if (len < hlen || len > PROTO_MAX_FRAME || read_full(fd, hdr, hlen) != 0) return -1;
+
+	*blen = len - hlen;
+	*body = malloc(*blen + 1);
+	if (!*body) {
+		fprintf(stderr, " failed to allocate %zu bytes. No memory\n", *blen + 1);
+		return -1;
+	}
+	if (read_full(fd, *body, *blen) != 0) {
+		free(*body);
+		*body = NULL;
+		return -1;
+	}
+	(*body)[*blen] = '\0';
+	return 0;
+}
@@ -0,0 +1,44 @@
+/***********************************************************
+ File Name: proto.h
+ Description: definition of the framed protocol spoken by
+              rkserve over a UNIX domain socket
+ **********************************************************/
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A frame is its length (uint32_t, host byte order: both ends are on the
+   same machine), then a fixed header and a body of that length minus the
+   header's. The client sends a request frame (proto_request and the
+   query) and the server answers each with a reply frame (proto_reply and
+   the result lines of rkmatch, or an error message). A connection carries
+   any number of requests, one at a time. */
+
+/* largest frame accepted */
+#define PROTO_MAX_FRAME (1U << 30)
+
+/* request flags */
+#define PROTO_QUERY_PATH 1   /* the body is the path of the query document, not its text */
+
+typedef struct {
+	int32_t algo;     /* as rkmatch -t */
+	int32_t k;
+	int32_t window;   /* winnowing window of -t 4, 0 for k */
+	int32_t flags;
+} proto_request;
+
+enum { PROTO_OK = 0, PROTO_ERROR };
+
+typedef struct {
+	int32_t status;   /* PROTO_OK, or PROTO_ERROR with the reason as body */
+	int32_t ndocs;    /* result lines in the body */
+} proto_reply;
+
+int proto_listen(const char *path);
+int proto_connect(const char *path);
+int proto_send(int fd, const void *hdr, size_t hlen, const char *body, size_t blen);
+int proto_recv(int fd, void *hdr, size_t hlen, char **body, size_t *blen);
+
+#endif
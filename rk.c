@@ -0,0 +1,1331 @@
+/***********************************************************
+ Implementation of the matching algorithms of rkmatch
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rk.h"
+#include "normalize.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RK_X86 1
+#endif
+
+/* a large prime for RK hash (below 2^62, see rk_set_modulus())*/
+long long BIG_PRIME = 5003943032159437; 
+
+/* constants used for printing debug information */
+const int PRINT_RK_HASH = 5;
+const int PRINT_BLOOM_BITS = 160;
+
+/* bytes read at a time when streaming the to-be-matched document */
+#define RK_STREAM_CHUNK (1 << 20)
+
+/* rolling hashes computed before probing the bloom filter with them */
+#define RK_BATCH 64
+
+/* positions rolled per lane before probing (see rk_scan()) */
+#define RK_STEPS 64
+
+/* smallest number of chunk positions worth handing to a scan thread */
+#define RK_MIN_RANGE (1 << 16)
+
+/* chunk positions scanned for every k before moving on (see rk_scan_ks()):
+   the piece of the target stays in the cache between the k */
+#define RK_KS_PIECE (1 << 18)
+long long int asc = 256;
+
+/* Reduction constants of the modulus p, with 2^(bits-1) <= p < 2^bits.
+	 x mod p for x < 2^(2*bits) is x - q*p (Barrett reduction), where
+	 q = ((x >> (bits-1)) * mu) >> (bits+1) with mu = 2^(2*bits) / p is at
+	 most 2 less than x / p. Multiplying a residue by asc = 256 splits it at
+	 bit bits-8 instead and looks the high byte up in shl8. They are set up
+	 for the default BIG_PRIME when the program is loaded, before any thread
+	 runs, and only change through rk_set_modulus(). */
+static struct {
+	long long p;
+	int bits;
+	uint64_t mu;
+	uint64_t shl8[256];   /* j * 2^bits mod p */
+} rk_mod;
+
+/* x mod p for x < 2^(2*bits): true when x is the product of two residues,
+	 or of a residue and a byte (p > asc) */
+static inline uint64_t
+barrett_reduce(unsigned __int128 x)
+{
+	uint64_t q, r;
+
+	q = (uint64_t)(((unsigned __int128)(uint64_t)(x >> (rk_mod.bits - 1)) * rk_mod.mu) >> (rk_mod.bits + 1));
+	r = (uint64_t)x - q * (uint64_t)rk_mod.p;
+	/* q is at most 2 short; branch free, as the corrections are unpredictable */
+	r -= rk_mod.p & -(uint64_t)(r >= (uint64_t)rk_mod.p);
+	r -= rk_mod.p & -(uint64_t)(r >= (uint64_t)rk_mod.p);
+	return r;
+}
+
+static void
+mod_init(long long p)
+{
+	rk_mod.p = p;
+	rk_mod.bits = 64 - __builtin_clzll(p);
+	rk_mod.mu = (uint64_t)(((unsigned __int128)1 << (2 * rk_mod.bits)) / p);
+	for (int j = 0; j < 256; j++) rk_mod.shl8[j] = barrett_reduce((unsigned __int128)j << rk_mod.bits);
+}
+
+__attribute__((constructor))
+static void
+mod_init_default(void)
+{
+	mod_init(BIG_PRIME);
+}
+
+/* Set the RK modulus. Return -1 if p is not usable: p must exceed asc, so
+	 that a byte is a residue, and be below 2^62, so that the sum of two
+	 residues does not overflow. Not safe while other threads hash: set it
+	 before starting them. */
+int
+rk_set_modulus(long long p)
+{
+	if (p <= asc || p >= (1LL << 62)) return -1;
+	BIG_PRIME = p;
+	mod_init(p);
+	return 0;
+}
+
+/* modulo addition */
+long long
+madd(long long a, long long b)
+{
+	return ((a+b)>=BIG_PRIME?(a+b-BIG_PRIME):(a+b));
+}
+
+
+/* modulo substraction */
+long long
+mdel(long long a, long long b)
+{
+	return ((a>=b)?(a-b):(a+BIG_PRIME-b));
+}
+
+/* modulo multiplication, with a 128-bit product and a Barrett reduction
+	 instead of a 64-bit division */
+long long
+mmul(long long a, long long b)
+{
+	if ((a | b) < 0 || a > BIG_PRIME || b > BIG_PRIME) {
+		return (long long)((__int128)a * b % BIG_PRIME);
+	}
+	return barrett_reduce((unsigned __int128)a * b);
+}
+
+/* mmul(h, asc) for a residue h, as used by the rolling loops: with
+	 h = hi * 2^(bits-8) + lo, h * 256 = hi * 2^bits + lo * 256 where
+	 lo * 256 < 2^bits. */
+static inline long long
+mmul_asc(long long h)
+{
+	int s = rk_mod.bits - 8;
+	uint64_t r = rk_mod.shl8[h >> s] + ((uint64_t)(h & ((1LL << s) - 1)) << 8);
+
+	r -= rk_mod.p & -(uint64_t)(r >= (uint64_t)rk_mod.p);
+	r -= rk_mod.p & -(uint64_t)(r >= (uint64_t)rk_mod.p);
+	return r;
+}
+
+/* asc^e modulo BIG_PRIME, by repeated squaring */
+long long
+rk_power(int e)
+{
+	long long r = 1 % BIG_PRIME, b = asc % BIG_PRIME;
+
+	for (; e > 0; e >>= 1) {
+		if (e & 1) r = mmul(r, b);
+		b = mmul(b, b);
+	}
+	return r;
+}
+
+/* reference kernel of simple_match(): compare ps with ts at every offset
+	 byte by byte */
+int
+simple_match_scalar(const char *ps,	/* the query string */
+						 int k, 					/* the length of the query string */
+						 const char *ts,	/* the document string (Y) */ 
+						 long long n			/* the length of the document Y */)
+{
+	if (k > n) {
+		return 0;
+	}
+
+	else {
+		int count;
+		for (long long i = 0; (i+k) <= n; i++){
+			count = 0;
+			for (int j = 0; j < k; j++){
+				if (ps[j] == ts[j+i]){ //checking if individual characters match
+					count++;
+				}
+
+				else{
+					break;
+				}
+			}
+
+			if (count>=k) return 1; 
+		}
+	}
+	return 0;
+}
+
+#ifdef RK_X86
+
+/* The vector kernels compare the first and the last byte of ps with 16/32
+	 consecutive candidate positions at once; only positions where both
+	 match are compared in full. The positions left over at the end of ts
+	 go to the scalar kernel. */
+static int
+simple_match_sse2(const char *ps, int k, const char *ts, long long n)
+{
+	__m128i first, last;
+	long long i = 0;
+
+	if (k < 2 || k > n) {
+		if (k == 1) return memchr(ts, ps[0], n) != NULL;
+		return simple_match_scalar(ps, k, ts, n);
+	}
+
+	first = _mm_set1_epi8(ps[0]);
+	last = _mm_set1_epi8(ps[k-1]);
+	for (; i + k - 1 + 16 <= n; i += 16) {
+		__m128i bf = _mm_loadu_si128((const __m128i *)(ts + i));
+		__m128i bl = _mm_loadu_si128((const __m128i *)(ts + i + k - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf),
+		                                                _mm_cmpeq_epi8(last, bl)));
+		for (; mask; mask &= mask - 1) {
+			if (!memcmp(ts + i + __builtin_ctz(mask) + 1, ps + 1, k - 2)) return 1;
+		}
+	}
+	return simple_match_scalar(ps, k, ts + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int
+simple_match_avx2(const char *ps, int k, const char *ts, long long n)
+{
+	__m256i first, last;
+	long long i = 0;
+
+	if (k < 2 || k > n) {
+		if (k == 1) return memchr(ts, ps[0], n) != NULL;
+		return simple_match_scalar(ps, k, ts, n);
+	}
+
+	first = _mm256_set1_epi8(ps[0]);
+	last = _mm256_set1_epi8(ps[k-1]);
+	for (; i + k - 1 + 32 <= n; i += 32) {
+		__m256i bf = _mm256_loadu_si256((const __m256i *)(ts + i));
+		__m256i bl = _mm256_loadu_si256((const __m256i *)(ts + i + k - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, bf),
+		                                                      _mm256_cmpeq_epi8(last, bl)));
+		for (; mask; mask &= mask - 1) {
+			if (!memcmp(ts + i + __builtin_ctz(mask) + 1, ps + 1, k - 2)) return 1;
+		}
+	}
+	return simple_match_scalar(ps, k, ts + i, n - i);
+}
+
+#endif /* RK_X86 */
+
+/* Return the simple_match() kernel called name ("scalar", "sse2", "avx2"),
+	 or NULL if it is not supported on this machine */
+match_fn
+simple_match_kernel(const char *name)
+{
+	if (strcmp(name, "scalar") == 0) return simple_match_scalar;
+#ifdef RK_X86
+	if (strcmp(name, "sse2") == 0) return simple_match_sse2;
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return simple_match_avx2;
+#endif
+	return NULL;
+}
+
+/* the kernels of simple_match() and of the rolling scans, set once by
+	 pick_kernels() */
+static match_fn best_match;
+static rk_roll_fn best_roll;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void
+pick_kernels(void)
+{
+	match_fn m = simple_match_kernel("avx2");
+	rk_roll_fn r = rk_roll_kernel("avx512");
+
+	if (!m) m = simple_match_kernel("sse2");
+	if (!m) m = simple_match_scalar;
+	if (!r) r = rk_roll_kernel("avx2");
+	if (!r) r = rk_roll_kernel("scalar");
+	best_match = m;
+	best_roll = r;
+}
+
+/* Pick the fastest kernels supported by the CPU. The first hash or match
+	 does so, whichever thread makes it; calling this first keeps the setup
+	 out of the threads. */
+void
+rk_init(void)
+{
+	pthread_once(&kernels_once, pick_kernels);
+}
+
+/* check if a query string ps (of length k) appears 
+	 in ts (of length n) as a substring 
+	 If so, return 1. Else return 0
+	 The fastest kernel supported by the CPU is picked on the first call.
+	 */
+int
+simple_match(const char *ps,	/* the query string */
+						 int k, 					/* the length of the query string */
+						 const char *ts,	/* the document string (Y) */ 
+						 long long n			/* the length of the document Y */)
+{
+	rk_init();
+	return best_match(ps, k, ts, n);
+}
+
+void hash(const char *ps,	/* the query string */
+								 int k, 					/* the length of the query string */
+								 const char *ts,	/* the document string (Y) */ 
+								 long long int *largest,
+								 long long int *hashps, long long int *hashts){
+	*largest = rk_power(k-1);
+	*hashps = calculate(ps, k);
+	*hashts = calculate(ts, k);
+}
+
+/* Check if a query string ps (of length k) appears 
+	 in ts (of length n) as a substring using the rabin-karp algorithm
+	 If so, return 1. Else return 0
+	 In addition, print the first 'PRINT_RK_HASH' hash values of ts
+	 Example:
+	 $ ./rkmatch -t 1 -k 20 X Y
+	 605818861882592 812687061542252 1113263531943837 1168659952685767 4992125708617222 
+	 0.01 matched: 1 out of 148
+	 */
+
+int
+rabin_karp_match(const char *ps,	/* the query string */
+								 int k, 					/* the length of the query string */
+								 const char *ts,	/* the document string (Y) */ 
+								 long long n			/* the length of the document Y */ )
+{
+	if (k > n) return 0;
+
+	else {
+		int printed = 0;
+		long long int hashps = 0, hashts = 0;
+		long long int largest = 0;
+		long long out[256];
+
+		/* power of the first element to enhance rolling hashing, hash of
+		   the query text and of the first substring of the document */
+		hash(ps, k, ts, &largest, &hashps, &hashts);
+		for (int c = 0; c < 256; c++) out[c] = mmul(largest, c);
+
+		
+		for (long long i = 0; (i+k) <= n; i++){
+			if (i > 0){	//rolling hashing
+				hashts = mdel(hashts, out[(unsigned char)ts[i-1]]);
+				hashts = mmul_asc(hashts);
+				hashts = madd(hashts, (unsigned char)ts[i+k-1]);
+			}
+
+			if(i<PRINT_RK_HASH){	//printing the first PRINT_RK_HASH hash values
+      			printf("%lld ", hashts);
+			}
+		    else if(i==PRINT_RK_HASH){
+		    	printed = 1;
+		      	printf("\n");
+		      
+		    }
+
+			if (hashts == hashps){	//checking if actual strings with same hash values match
+				int count = 0;
+				for (int j = 0; j < k; j++){
+					if (ps[j] == ts[j+i]){
+						count++;
+					}
+
+					else{
+						break;
+					}	
+				}
+
+				if (count >= k) {
+					if (!printed) printf("\n");
+					return 1;
+					
+				}
+			}
+		}
+	
+	}
+	return 0;
+}
+
+/* Initialize the bitmap for the bloom filter using bloom_init().
+	 Insert all m/k RK hashes of qs into the bloom filter using bloom_add().
+	 Then, compute each of the n-k+1 RK hashes of ts and check if it's in the filter using bloom_query().
+	 Use the given procedure, hash_i(i, p), to compute the i-th bloom filter hash value for the RK value p.
+
+	 Return the number of matched chunks. 
+	 Additionally, print out the first PRINT_BLOOM_BITS of the bloom filter using the given bloom_print 
+	 after inserting m/k substrings from qs.
+*/
+
+
+/* RK hash of the k characters of ps: the sum of ps[i]*asc^(k-1-i),
+	 evaluated by Horner's rule in O(k) */
+long long calculate(const char *ps, int k) {
+
+	long long int hashps = 0;
+	for (int i = 0; i < k; i++){
+			hashps = madd(mmul_asc(hashps), (unsigned char)ps[i]);
+	}
+	return hashps;
+
+}
+
+/* Fill the table of the hash of each byte leaving the rolling window,
+	 weighted by asc^k as it is taken off after the window was shifted */
+static void
+init_out(rk_query *q)
+{
+	long long pow = rk_power(q->k);
+
+	for (int c = 0; c < 256; c++) q->out[c] = mmul(pow, c);
+}
+
+/* Build the query side of the batch matcher: an exact index from the RK
+	 hash of every distinct m/k chunk of qs to its offset, and, unless filter
+	 has no bitmap, a bloom filter holding the same hashes as a pre-filter. */
+rk_query
+rk_build_query(bloom_filter filter, /* empty filter to fill, buf is NULL for none */
+               int k,          /* chunk length to be matched */
+               const char *qs, /* query docoument (X)*/
+               long long m     /* query document length */)
+{
+	rk_query q = { k, qs, m, filter };
+
+	init_out(&q);
+
+	q.chunks = hashtab_init(m / k);
+
+	for (long long i = 0; (i+k) <= m; i+=k){	//computing hash values
+		long long hashqs = calculate(qs+i, k);
+		long long s;
+
+		if (q.filter.buf) bloom_add(q.filter, hashqs);	//adding element to bloom filter
+
+		/* repeated chunks are indexed once */
+		for (s = hashtab_home(&q.chunks, hashqs); q.chunks.slots[s].key != HASHTAB_EMPTY;
+		     s = (s+1) & q.chunks.mask) {
+			if (q.chunks.slots[s].key == hashqs && !strncmp(&qs[q.chunks.slots[s].val], &qs[i], k)) break;
+		}
+		if (q.chunks.slots[s].key == HASHTAB_EMPTY) hashtab_add(&q.chunks, hashqs, i);
+	}
+	return q;
+}
+
+void
+rk_free_query(rk_query *q)
+{
+	if (q->filter.buf) bloom_free(&q->filter);
+	hashtab_free(&q->chunks);
+}
+
+/* The query is kept after the bitmap of a filter file (-o/-f) so that the
+	 exact verification needs neither the query document nor its hashes */
+struct rk_saved_query {
+	int64_t m;        /* length of the normalized query */
+	int64_t nchunks;  /* distinct chunks */
+	/* followed by the nchunks hashtab_entry of the chunks and the m bytes of the query */
+};
+
+/* Save the bloom filter of q and q itself into the filter file fname.
+	 A query shorter than one chunk has nothing to save (its filter is
+	 empty, and bloom_load() rejects empty filters).
+	 Return 0 on success, -1 on error. */
+int
+rk_save_query(const rk_query *q, const char *fname)
+{
+	struct rk_saved_query *sq;
+	hashtab_entry *ents;
+	bloom_meta meta = { q->k, BIG_PRIME, q->m / q->k };
+	long long n = 0;
+	int ret;
+
+	if (q->m / q->k < 1 || q->filter.bsz < 1) {
+		fprintf(stderr, "%s: query shorter than one chunk of %d characters, no filter saved\n", fname, q->k);
+		return -1;
+	}
+
+	meta.extra_len = sizeof(*sq) + q->chunks.n * sizeof(hashtab_entry) + q->m;
+	sq = malloc(meta.extra_len);
+	if (!sq) {
+		fprintf(stderr, " failed to allocate %lld bytes. No memory\n", meta.extra_len);
+		return -1;
+	}
+	sq->m = q->m;
+	sq->nchunks = q->chunks.n;
+	ents = (hashtab_entry *)(sq + 1);
+	for (long long s = 0; s <= q->chunks.mask; s++) {
+		if (q->chunks.slots[s].key != HASHTAB_EMPTY) ents[n++] = q->chunks.slots[s];
+	}
+	memcpy(ents + n, q->qs, q->m);
+
+	meta.extra = sq;
+	ret = bloom_save(q->filter, &meta, fname);
+	free(sq);
+	return ret;
+}
+
+/* Load the query saved by rk_save_query() into q. The filter and the query
+	 text stay in the read-only mapping of the file, only the index of the
+	 chunks is rebuilt. k and modulus are set to the values of the file, and
+	 the file's modulus becomes the RK modulus.
+	 Return 0 on success, -1 on error. */
+int
+rk_load_query(const char *fname, rk_query *q, int *k, long long *modulus)
+{
+	bloom_meta meta;
+	const struct rk_saved_query *sq;
+	const hashtab_entry *ents;
+
+	if (bloom_load(fname, &q->filter, &meta) != 0) return -1;
+	sq = meta.extra;
+	if (meta.k < 1 || meta.extra_len < (long long)sizeof(*sq) || sq->m < 0 || sq->nchunks < 0
+	    || meta.extra_len != (long long)(sizeof(*sq) + sq->nchunks * sizeof(hashtab_entry) + sq->m)) {
+		fprintf(stderr, "%s: not a query filter file\n", fname);
+		bloom_free(&q->filter);
+		return -1;
+	}
+	ents = (const hashtab_entry *)(sq + 1);
+
+	q->k = *k = meta.k;
+	*modulus = meta.modulus;
+	q->stats = NULL;
+	q->m = sq->m;
+	q->qs = (const char *)(ents + sq->nchunks);
+	if (rk_set_modulus(meta.modulus) != 0) {
+		fprintf(stderr, "%s: invalid modulus %lld\n", fname, meta.modulus);
+		bloom_free(&q->filter);
+		return -1;
+	}
+	init_out(q);
+	q->chunks = hashtab_init(sq->nchunks);
+	for (long long i = 0; i < sq->nchunks; i++) hashtab_add(&q->chunks, ents[i].key, ents[i].val);
+	return 0;
+}
+
+/* Rolling hash kernels. The chunk positions of the target are split into
+	 RK_LANES contiguous segments (lanes) that are rolled through side by
+	 side, so that the serial dependency of one rolling hash on the previous
+	 one is spread over independent chains. A kernel advances the lanes by
+	 steps positions: hashes[s*RK_LANES + j] is set to h[j], the hash of the
+	 window of lane j, before h[j] is rolled by d[s*RK_LANES + j], the hash
+	 of the byte entering minus the one leaving the window:
+	   h = madd(mmul_asc(h), d) */
+static void
+roll_scalar(long long *h, const long long *d, int steps, long long *hashes)
+{
+	for (int s = 0; s < steps; s++) {
+		for (int j = 0; j < RK_LANES; j++) {
+			hashes[s*RK_LANES + j] = h[j];
+			h[j] = madd(mmul_asc(h[j]), d[s*RK_LANES + j]);
+		}
+	}
+}
+
+#ifdef RK_X86
+
+/* x - p where x >= p, for 0 <= x < 2^63 */
+__attribute__((target("avx2")))
+static inline __m256i
+condsub_avx2(__m256i x, __m256i p)
+{
+	return _mm256_sub_epi64(x, _mm256_andnot_si256(_mm256_cmpgt_epi64(p, x), p));
+}
+
+/* mmul_asc() on 4 lanes: the table entries of the high bytes are gathered */
+__attribute__((target("avx2")))
+static void
+roll_avx2(long long *h, const long long *d, int steps, long long *hashes)
+{
+	const __m256i p = _mm256_set1_epi64x(rk_mod.p);
+	const __m256i lomask = _mm256_set1_epi64x((1LL << (rk_mod.bits - 8)) - 1);
+	const __m128i shift = _mm_cvtsi32_si128(rk_mod.bits - 8);
+	const long long *shl8 = (const long long *)rk_mod.shl8;
+	__m256i hv[RK_LANES / 4];
+
+	for (int v = 0; v < RK_LANES / 4; v++) hv[v] = _mm256_loadu_si256((const __m256i *)(h + 4*v));
+	for (int s = 0; s < steps; s++) {
+		for (int v = 0; v < RK_LANES / 4; v++) {
+			__m256i x = hv[v], r;
+
+			_mm256_storeu_si256((__m256i *)(hashes + s*RK_LANES + 4*v), x);
+			r = _mm256_i64gather_epi64(shl8, _mm256_srl_epi64(x, shift), 8);
+			r = _mm256_add_epi64(r, _mm256_slli_epi64(_mm256_and_si256(x, lomask), 8));
+			r = condsub_avx2(condsub_avx2(r, p), p);
+			r = _mm256_add_epi64(r, _mm256_loadu_si256((const __m256i *)(d + s*RK_LANES + 4*v)));
+			hv[v] = condsub_avx2(r, p);
+		}
+	}
+	for (int v = 0; v < RK_LANES / 4; v++) _mm256_storeu_si256((__m256i *)(h + 4*v), hv[v]);
+}
+
+/* same on 8 lanes, with the corrections done under compare masks */
+__attribute__((target("avx512f")))
+static void
+roll_avx512(long long *h, const long long *d, int steps, long long *hashes)
+{
+	const __m512i p = _mm512_set1_epi64(rk_mod.p);
+	const __m512i lomask = _mm512_set1_epi64((1LL << (rk_mod.bits - 8)) - 1);
+	const __m128i shift = _mm_cvtsi32_si128(rk_mod.bits - 8);
+	const long long *shl8 = (const long long *)rk_mod.shl8;
+	__m512i hv[RK_LANES / 8];
+
+	for (int v = 0; v < RK_LANES / 8; v++) hv[v] = _mm512_loadu_si512(h + 8*v);
+	for (int s = 0; s < steps; s++) {
+		for (int v = 0; v < RK_LANES / 8; v++) {
+			__m512i x = hv[v], r;
+
+			_mm512_storeu_si512(hashes + s*RK_LANES + 8*v, x);
+			r = _mm512_i64gather_epi64(_mm512_srl_epi64(x, shift), shl8, 8);
+			r = _mm512_add_epi64(r, _mm512_slli_epi64(_mm512_and_si512(x, lomask), 8));
+			r = _mm512_mask_sub_epi64(r, _mm512_cmpge_epu64_mask(r, p), r, p);
+			r = _mm512_mask_sub_epi64(r, _mm512_cmpge_epu64_mask(r, p), r, p);
+			r = _mm512_add_epi64(r, _mm512_loadu_si512(d + s*RK_LANES + 8*v));
+			hv[v] = _mm512_mask_sub_epi64(r, _mm512_cmpge_epu64_mask(r, p), r, p);
+		}
+	}
+	for (int v = 0; v < RK_LANES / 8; v++) _mm512_storeu_si512(h + 8*v, hv[v]);
+}
+
+#endif /* RK_X86 */
+
+/* Return the rolling hash kernel called name ("scalar", "avx2", "avx512"),
+	 or NULL if it is not supported on this machine */
+rk_roll_fn
+rk_roll_kernel(const char *name)
+{
+	if (strcmp(name, "scalar") == 0) return roll_scalar;
+#ifdef RK_X86
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) return roll_avx2;
+	if (strcmp(name, "avx512") == 0 && __builtin_cpu_supports("avx512f")) return roll_avx512;
+#endif
+	return NULL;
+}
+
+static rk_roll_fn
+best_roll_kernel(void)
+{
+	rk_init();
+	return best_roll;
+}
+
+/* state of the lanes rolling over the npos chunk positions of ts */
+struct roller {
+	const rk_query *q;
+	const char *ts;
+	long long seg;                  /* positions per lane */
+	rk_roll_fn fn;
+	long long h[RK_LANES];
+	long long d[RK_STEPS * RK_LANES];
+};
+
+static void
+roller_init(struct roller *r, const rk_query *q, const char *ts, long long npos, rk_roll_fn fn)
+{
+	r->q = q;
+	r->ts = ts;
+	r->seg = npos / RK_LANES;
+	r->fn = fn;
+	for (int j = 0; j < RK_LANES; j++) r->h[j] = calculate(ts + j * r->seg, q->k);
+}
+
+/* Hash the positions start..start+steps-1 of every lane into hashes (see
+	 roll_scalar()) and return steps, at most RK_STEPS */
+static int
+roller_block(struct roller *r, long long start, long long *hashes)
+{
+	const unsigned char *ts = (const unsigned char *)r->ts;
+	const long long *out = r->q->out;
+	int k = r->q->k;
+	int steps = r->seg - start < RK_STEPS ? r->seg - start : RK_STEPS;
+	/* the last window of a lane is not rolled further: the byte after it
+	   may lie past the end of ts */
+	int rolls = start + steps == r->seg ? steps - 1 : steps;
+
+	for (int j = 0; j < RK_LANES; j++) {
+		const unsigned char *t = ts + j * r->seg + start;
+		for (int s = 0; s < rolls; s++) r->d[s*RK_LANES + j] = mdel(t[s+k], out[t[s]]);
+		if (rolls < steps) r->d[rolls*RK_LANES + j] = 0;
+	}
+	r->fn(r->h, r->d, steps, hashes);
+	return steps;
+}
+
+/* Compute the hashes of all n-k+1 chunks of ts, in position order, with
+	 the rolling hash kernel fn, or one after the other if fn is NULL (for
+	 testing and benchmarking the kernels) */
+void
+rk_hash_all(const rk_query *q, rk_roll_fn fn, const char *ts, long long n, long long *out)
+{
+	static __thread long long hashes[RK_STEPS * RK_LANES];
+	const unsigned char *t = (const unsigned char *)ts;
+	struct roller r;
+	long long npos = n - q->k + 1, i;
+
+	if (npos <= 0) return;
+	if (!fn) {
+		out[0] = calculate(ts, q->k);
+		for (i = 1; i < npos; i++) {
+			out[i] = madd(mmul_asc(out[i-1]), mdel(t[i+q->k-1], q->out[t[i-1]]));
+		}
+		return;
+	}
+	roller_init(&r, q, ts, npos, fn);
+	for (long long start = 0; start < r.seg; ) {
+		int steps = roller_block(&r, start, hashes);
+		for (int s = 0; s < steps; s++) {
+			for (int j = 0; j < RK_LANES; j++) out[j * r.seg + start + s] = hashes[s*RK_LANES + j];
+		}
+		start += steps;
+	}
+	for (i = RK_LANES * r.seg; i < npos; i++) out[i] = calculate(ts + i, q->k);
+}
+
+/* Compute the RK hashes of all n-k+1 chunks of ts, in position order, with
+	 the fastest rolling hash kernel */
+void
+rk_hash_positions(int k, const char *ts, long long n, long long *out)
+{
+	rk_query q = { k };
+
+	init_out(&q);
+	rk_hash_all(&q, n - k + 1 < RK_LANES * RK_STEPS ? NULL : best_roll_kernel(), ts, n, out);
+}
+
+/* Return the offset in the query of the chunk equal to the k characters
+	 at t, whose hash is h, or -1 if there is none. The number of bytes
+	 compared is added to *bytes unless bytes is NULL. */
+static inline long long
+verify(const rk_query *q, long long h, const char *t, long long *bytes)
+{
+	const hashtab *chunks = &q->chunks;
+
+	for (long long s = hashtab_home(chunks, h); chunks->slots[s].key != HASHTAB_EMPTY;
+	     s = (s+1) & chunks->mask) {
+		const char *c = &q->qs[chunks->slots[s].val];
+		int j = 0;
+
+		if (chunks->slots[s].key != h) continue;
+		if (!bytes) {
+			if (!strncmp(c, t, q->k)) return chunks->slots[s].val;
+			continue;
+		}
+		while (j < q->k && c[j] == t[j]) j++;
+		*bytes += j < q->k ? j + 1 : j;
+		if (j == q->k) return chunks->slots[s].val;
+	}
+	return -1;
+}
+
+/* verify() exposed for benchmarking the verification on its own */
+int
+rk_verify(const rk_query *q, long long h, const char *t)
+{
+	return verify(q, h, t, NULL) >= 0;
+}
+
+void
+rk_hits_init(rk_hits *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void
+rk_hits_free(rk_hits *h)
+{
+	free(h->v);
+	rk_hits_init(h);
+}
+
+void
+rk_hits_add(rk_hits *h, long long toff, long long qoff)
+{
+	if (h->n == h->cap) {
+		long long cap = h->cap ? 2 * h->cap : 1024;
+		rk_hit *v = realloc(h->v, cap * sizeof(rk_hit));
+		if (!v) {
+			fprintf(stderr, " failed to allocate %lld matches. No memory\n", cap);
+			exit(1);
+		}
+		h->v = v;
+		h->cap = cap;
+	}
+	h->v[h->n++] = (rk_hit){ toff, qoff };
+}
+
+static int
+cmp_hit(const void *x, const void *y)
+{
+	long long a = ((const rk_hit *)x)->toff, b = ((const rk_hit *)y)->toff;
+	return a < b ? -1 : a > b;
+}
+
+/* Add the counters of one scan to the query's. The scans of a document
+	 may run on several threads, each adds its own counts once. */
+static void
+stats_add(rk_stats *to, const rk_stats *st)
+{
+	__atomic_fetch_add(&to->probes, st->probes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&to->hits, st->hits, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&to->matches, st->matches, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&to->verify_bytes, st->verify_bytes, __ATOMIC_RELAXED);
+}
+
+/* rk_scan() computing one rolling hash after the other. Probes and hits
+	 are counted into st unless it is NULL, the matches are added to hits
+	 (ts being at offset base of the text hits->base is the offset of)
+	 unless it is NULL, and each match adds one to tally[qoff/k] unless
+	 tally is NULL; inlined with constant NULLs, the counting and the
+	 recording are compiled out of the plain scan. */
+static inline __attribute__((always_inline)) long long
+scan_serial(const rk_query *q, const char *ts, long long n, rk_stats *st, rk_hits *hits,
+            long long *tally, long long base)
+{
+	int k = q->k;
+	long long int hashts = 0;
+	long long count = 0;
+	long long hashes[RK_BATCH];
+	uint8_t pass[RK_BATCH];
+
+	for (long long b = 0; (b+k) <= n; b += RK_BATCH){
+		long long cnt = n-k+1 - b < RK_BATCH ? n-k+1 - b : RK_BATCH;
+
+		for (long long i = b; i < b + cnt; i++){
+			if (i==0){
+				hashts = calculate(ts, k);
+			}
+
+			if(i > 0){	//rolling hashing
+				/* the byte leaving and the byte entering the window do not
+				   depend on the hash: combine them off the critical path */
+				long long d = mdel((unsigned char)ts[i+k-1], q->out[(unsigned char)ts[i-1]]);
+				hashts = madd(mmul_asc(hashts), d);
+			}
+			hashes[i-b] = hashts;
+		}
+
+		if (q->filter.buf) {
+			bloom_query_batch(q->filter, hashes, cnt, pass);
+		} else {
+			memset(pass, 1, cnt);
+		}
+		if (st) st->probes += cnt;
+
+		for (long long j = 0; j < cnt; j++){
+			if (pass[j]) {
+				long long qoff = verify(q, hashes[j], &ts[b+j], st ? &st->verify_bytes : NULL);
+
+				if (st) st->hits++;
+				if (qoff >= 0) {
+					count++;
+					if (hits) rk_hits_add(hits, hits->base + base + b + j, qoff);
+					if (tally) tally[qoff / k]++;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+/* rk_scan() counting into st and recording into hits and tally unless
+	 they are NULL (see scan_serial()); the matches are not in target order */
+static inline __attribute__((always_inline)) long long
+scan_lanes(const rk_query *q, const char *ts, long long n, rk_stats *st, rk_hits *hits,
+           long long *tally)
+{
+	static __thread long long hashes[RK_STEPS * RK_LANES];
+	static __thread uint8_t pass[RK_STEPS * RK_LANES];
+	long long npos = n - q->k + 1, count = 0;
+	struct roller r;
+
+	/* too short to fill the lanes */
+	if (npos < RK_LANES * RK_STEPS) return scan_serial(q, ts, n, st, hits, tally, 0);
+
+	roller_init(&r, q, ts, npos, best_roll_kernel());
+	for (long long start = 0; start < r.seg; ) {
+		int steps = roller_block(&r, start, hashes);
+		int cnt = steps * RK_LANES;
+
+		if (q->filter.buf) {
+			bloom_query_batch(q->filter, hashes, cnt, pass);
+		} else {
+			memset(pass, 1, cnt);
+		}
+		if (st) st->probes += cnt;
+		for (int i = 0; i < cnt; i++) {
+			if (pass[i]) {
+				long long pos = (i % RK_LANES) * r.seg + start + i / RK_LANES;
+				long long qoff = verify(q, hashes[i], ts + pos, st ? &st->verify_bytes : NULL);
+
+				if (st) st->hits++;
+				if (qoff >= 0) {
+					count++;
+					if (hits) rk_hits_add(hits, hits->base + pos, qoff);
+					if (tally) tally[qoff / q->k]++;
+				}
+			}
+		}
+		start += steps;
+	}
+
+	/* positions left over after RK_LANES equal segments */
+	ts += RK_LANES * r.seg;
+	return count + scan_serial(q, ts, n - RK_LANES * r.seg, st, hits, tally, RK_LANES * r.seg);
+}
+
+/* Count the positions of ts whose k-character chunk is equal to one of the
+	 m/k chunks of the query. Rolling hashes are computed for RK_LANES lanes
+	 of RK_STEPS positions at a time by the fastest rolling hash kernel and
+	 probed together with bloom_query_batch(); a position whose hash passes
+	 the bloom filter is only compared against the query chunks sharing its
+	 exact hash. The hashes of the first chunks are computed from scratch,
+	 so ts may be any piece of the target document. If q->stats is set, the
+	 scan is counted into it. */
+long long
+rk_scan(const rk_query *q,  /* built by rk_build_query() */
+        const char *ts,     /* (piece of the) to-be-matched document (Y) */
+        long long n         /* length of ts */)
+{
+	rk_stats st = { 0 };
+
+	if (!q->stats) return scan_lanes(q, ts, n, NULL, NULL, NULL);
+	st.matches = scan_lanes(q, ts, n, &st, NULL, NULL);
+	stats_add(q->stats, &st);
+	return st.matches;
+}
+
+/* rk_scan() also adding every match to hits, in target order. ts is at
+	 offset hits->base of the target. */
+long long
+rk_scan_hits(const rk_query *q, const char *ts, long long n, rk_hits *hits)
+{
+	rk_stats st = { 0 };
+	long long first = hits->n;
+
+	st.matches = scan_lanes(q, ts, n, q->stats ? &st : NULL, hits, NULL);
+	if (q->stats) stats_add(q->stats, &st);
+	qsort(hits->v + first, hits->n - first, sizeof(rk_hit), cmp_hit);
+	return st.matches;
+}
+
+/* rk_scan() also adding, for every match, one to tally[c] where c is the
+	 number (qoff/k) of the query chunk matched */
+long long
+rk_scan_tally(const rk_query *q, const char *ts, long long n, long long *tally)
+{
+	rk_stats st = { 0 };
+
+	if (!q->stats) return scan_lanes(q, ts, n, NULL, NULL, tally);
+	st.matches = scan_lanes(q, ts, n, &st, NULL, tally);
+	stats_add(q->stats, &st);
+	return st.matches;
+}
+
+struct scan_job {
+	const rk_query *q;
+	const char *ts;
+	long long n;
+	long long count;
+	rk_hits *hits;   /* matches of the range, NULL if not recorded */
+	long long *tally; /* matches per query chunk, NULL if not counted */
+};
+
+/* Run fn on each of the njobs jobs of size bytes at jobs: the first one on
+	 this thread, every other one on a thread of its own, or on this thread
+	 too if that thread cannot be spawned. Return once they are all done. */
+void
+rk_run_jobs(void *(*fn)(void *), void *jobs, size_t size, int njobs)
+{
+	char *job = jobs;
+	pthread_t *tids;
+	int t;
+
+	if (njobs <= 1) {
+		if (njobs == 1) fn(job);
+		return;
+	}
+	tids = malloc(njobs * sizeof(pthread_t));
+	if (!tids) {
+		fprintf(stderr, " failed to allocate %d threads. No memory\n", njobs);
+		exit(1);
+	}
+	for (t = 1; t < njobs; t++) {
+		if (pthread_create(&tids[t], NULL, fn, job + t * size) != 0) {
+			fn(job + t * size);
+			tids[t] = pthread_self();
+		}
+	}
+	fn(job);
+	for (t = 1; t < njobs; t++) {
+		if (!pthread_equal(tids[t], pthread_self())) pthread_join(tids[t], NULL);
+	}
+	free(tids);
+}
+
+static void *
+scan_thread(void *arg)
+{
+	struct scan_job *job = arg;
+
+	if (job->hits) {
+		job->count = rk_scan_hits(job->q, job->ts, job->n, job->hits);
+	} else if (job->tally) {
+		job->count = rk_scan_tally(job->q, job->ts, job->n, job->tally);
+	} else {
+		job->count = rk_scan(job->q, job->ts, job->n);
+	}
+	return NULL;
+}
+
+/* rk_scan() with the n-k+1 chunk positions of ts split into nthreads
+	 contiguous ranges. Each range is extended by k-1 bytes so its last chunk
+	 is complete, and is hashed from scratch by its own thread; the query
+	 index is only read. Every position belongs to exactly one range, so
+	 the per-range counts add up to the serial result.
+	 Unless hits is NULL, the matches are added to it in target order (see
+	 rk_scan_hits()): each range collects its own, which are appended range
+	 after range. Likewise, unless tally is NULL, the matches of each query
+	 chunk are added to it (see rk_scan_tally()). */
+static long long
+scan_ranges(const rk_query *q, const char *ts, long long n, int nthreads, rk_hits *hits,
+            long long *tally)
+{
+	int k = q->k;
+	long long npos = n - k + 1, nchunks = q->m / k;
+	struct scan_job *jobs;
+	rk_hits *own;
+	long long **own_tally;
+	long long count = 0;
+	int t;
+
+	if (nthreads > npos / RK_MIN_RANGE) nthreads = npos / RK_MIN_RANGE;
+	if (nthreads <= 1) {
+		if (hits) return rk_scan_hits(q, ts, n, hits);
+		return tally ? rk_scan_tally(q, ts, n, tally) : rk_scan(q, ts, n);
+	}
+
+	jobs = malloc(nthreads * sizeof(struct scan_job));
+	own = calloc(nthreads, sizeof(rk_hits));
+	own_tally = calloc(nthreads, sizeof(long long *));
+	if (!jobs || !own || !own_tally) {
+		fprintf(stderr, " failed to allocate %d scan jobs. No memory\n", nthreads);
+		exit(1);
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		long long start = npos * t / nthreads, end = npos * (t+1) / nthreads;
+		jobs[t] = (struct scan_job){ q, ts + start, end - start + k - 1, 0 };
+		if (hits) {
+			/* the first range adds to hits directly */
+			jobs[t].hits = t == 0 ? hits : &own[t];
+			own[t].base = hits->base + start;
+		}
+		if (tally) {
+			/* so does it to tally */
+			if (t > 0 && !(own_tally[t] = calloc(nchunks + 1, sizeof(long long)))) {
+				fprintf(stderr, " failed to allocate %lld counters. No memory\n", nchunks + 1);
+				exit(1);
+			}
+			jobs[t].tally = t == 0 ? tally : own_tally[t];
+		}
+	}
+
+	rk_run_jobs(scan_thread, jobs, sizeof(struct scan_job), nthreads);
+	for (t = 0; t < nthreads; t++) {
+		count += jobs[t].count;
+		if (hits && t > 0) {
+			for (long long i = 0; i < own[t].n; i++) rk_hits_add(hits, own[t].v[i].toff, own[t].v[i].qoff);
+			rk_hits_free(&own[t]);
+		}
+		if (tally && t > 0) {
+			for (long long c = 0; c < nchunks; c++) tally[c] += own_tally[t][c];
+			free(own_tally[t]);
+		}
+	}
+
+	free(jobs);
+	free(own);
+	free(own_tally);
+	return count;
+}
+
+/* scan_ranges() recording the matches into hits unless it is NULL */
+long long
+rk_scan_parallel(const rk_query *q, const char *ts, long long n, int nthreads, rk_hits *hits)
+{
+	return scan_ranges(q, ts, n, nthreads, hits, NULL);
+}
+
+/* Add to counts[i] the number of positions p of ts in [first, last) whose
+	 chunk of length q[i].k, if it is complete, is one of the chunks of
+	 q[i]. The positions are taken RK_KS_PIECE at a time, each piece being
+	 scanned for every query in turn. */
+static void
+scan_ks(const rk_query *q, int nk, const char *ts, long long n, long long first, long long last,
+        long long *counts)
+{
+	for (long long off = first; off < last; off += RK_KS_PIECE) {
+		for (int i = 0; i < nk; i++) {
+			long long end = off + RK_KS_PIECE;
+
+			if (end > last) end = last;
+			if (end > n - q[i].k + 1) end = n - q[i].k + 1;
+			if (end > off) counts[i] += rk_scan(&q[i], ts + off, end - off + q[i].k - 1);
+		}
+	}
+}
+
+struct ks_job {
+	const rk_query *q;
+	int nk;
+	const char *ts;
+	long long n, first, last;
+	long long *counts;
+};
+
+static void *
+ks_thread(void *arg)
+{
+	struct ks_job *job = arg;
+
+	scan_ks(job->q, job->nk, job->ts, job->n, job->first, job->last, job->counts);
+	return NULL;
+}
+
+/* Match ts against the nk queries q[i], built from the same query document
+	 with different chunk lengths, in a single pass over ts: set counts[i] to
+	 rk_scan(&q[i], ts, n). Each piece of ts is read from memory once and
+	 rolled over by the lane kernels of every k while it is in the cache.
+	 The chunk positions are split into nthreads contiguous ranges as in
+	 rk_scan_parallel(). */
+void
+rk_scan_ks(const rk_query *q, int nk, const char *ts, long long n, int nthreads, long long *counts)
+{
+	long long npos = 0, *own;   /* positions of the smallest k */
+	struct ks_job *jobs;
+	int t;
+
+	for (int i = 0; i < nk; i++) {
+		counts[i] = 0;
+		if (n - q[i].k + 1 > npos) npos = n - q[i].k + 1;
+	}
+	if (nthreads > npos / RK_MIN_RANGE) nthreads = npos / RK_MIN_RANGE;
+	if (nthreads <= 1) {
+		scan_ks(q, nk, ts, n, 0, npos, counts);
+		return;
+	}
+
+	jobs = malloc(nthreads * sizeof(struct ks_job));
+	own = calloc((long long)nthreads * nk, sizeof(long long));
+	if (!jobs || !own) {
+		fprintf(stderr, " failed to allocate %d scan jobs. No memory\n", nthreads);
+		exit(1);
+	}
+	for (t = 0; t < nthreads; t++) {
+		jobs[t] = (struct ks_job){ q, nk, ts, n, npos * t / nthreads, npos * (t+1) / nthreads,
+		                           own + (long long)t * nk };
+	}
+	rk_run_jobs(ks_thread, jobs, sizeof(struct ks_job), nthreads);
+	for (t = 0; t < nthreads; t++) {
+		for (int i = 0; i < nk; i++) counts[i] += jobs[t].counts[i];
+	}
+
+	free(jobs);
+	free(own);
+}
+
+long long
+rabin_karp_batchmatch(long long bsz,  /* size of bitmap (in bits) to be used */
+                      int k,          /* chunk length to be matched */
+                      const char *qs, /* query docoument (X)*/
+                      long long m,    /* query document length */ 
+                      const char *ts, /* to-be-matched document (Y) */
+                      long long n,    /* to-be-matched document length*/
+                      int nthreads    /* number of threads scanning ts */)
+{
+	rk_query q = rk_build_query(bsz > 0 ? bloom_init(bsz) : (bloom_filter){ 0 }, k, qs, m);
+	long long count;
+
+	bloom_print(q.filter, PRINT_BLOOM_BITS);	//printing bits
+
+	count = rk_scan_parallel(&q, ts, n, nthreads, NULL);
+
+	rk_free_query(&q);
+	return count;
+}
+
+/* Build the query side of the batch matcher for the nq query documents
+	 qs[i] of lengths m[i] at once: one filter and one exact index over the
+	 chunks of all of them, so that the target is scanned once for the
+	 batch. The queries are copied one after the other, each cut to a
+	 multiple of k, so the chunk numbered c (at offset c*k) is the same as
+	 in rk_build_query() of its own query and is tagged with its query in
+	 owner[c]. The index holds the first chunk of each distinct text;
+	 next[c] links it to the first chunk with the same text in each later
+	 query. */
+rk_multi
+rk_build_multi(bloom_filter filter, /* empty filter to fill, buf is NULL for none */
+               int k,               /* chunk length to be matched */
+               const char **qs,     /* query documents */
+               const long long *m,  /* their lengths */
+               int nq               /* number of queries */)
+{
+	rk_multi mq = { .nqueries = nq };
+	long long total = 0, c = 0, *last;
+	char *buf;
+
+	for (int i = 0; i < nq; i++) total += m[i] / k * k;
+	buf = malloc(total + 1);
+	mq.first = malloc((nq + 1) * sizeof(long long));
+	mq.owner = malloc((total / k + 1) * sizeof(int));
+	mq.next = malloc((total / k + 1) * sizeof(long long));
+	last = malloc((total / k + 1) * sizeof(long long));
+	if (!buf || !mq.first || !mq.owner || !mq.next || !last) {
+		fprintf(stderr, " failed to allocate the chunks of %d queries. No memory\n", nq);
+		exit(1);
+	}
+	for (int i = 0; i < nq; i++) {
+		long long len = m[i] / k * k;
+
+		memcpy(buf + c * k, qs[i], len);
+		mq.first[i] = c;
+		for (long long j = 0; j < len / k; j++) mq.owner[c++] = i;
+	}
+	mq.first[nq] = c;
+	buf[total] = '\0';
+	mq.q = rk_build_query(filter, k, buf, total);
+
+	/* last[d]: the last chunk linked from the indexed chunk d. Chunks are
+	   visited in query order, so a query repeating a text is linked once. */
+	for (c = 0; c < total / k; c++) {
+		long long d = verify(&mq.q, calculate(buf + c * k, k), buf + c * k, NULL) / k;
+
+		mq.next[c] = -1;
+		if (d == c) {
+			last[c] = c;
+		} else if (mq.owner[last[d]] != mq.owner[c]) {
+			mq.next[last[d]] = c;
+			last[d] = c;
+		}
+	}
+	free(last);
+	return mq;
+}
+
+void
+rk_free_multi(rk_multi *mq)
+{
+	free((char *)mq->q.qs);
+	rk_free_query(&mq->q);
+	free(mq->first);
+	free(mq->owner);
+	free(mq->next);
+}
+
+/* Scan ts once with nthreads threads (see rk_scan_parallel()) and set
+	 counts[i] to the number of positions of ts whose chunk is one of the
+	 chunks of query i, as rk_scan() with that query alone would. Every
+	 match is counted against the indexed chunk, which is credited to each
+	 query holding its text after the scan. Return the number of positions
+	 matching some query. */
+long long
+rk_scan_multi(const rk_multi *mq, const char *ts, long long n, int nthreads, long long *counts)
+{
+	long long nchunks = mq->first[mq->nqueries];
+	long long *tally = calloc(nchunks + 1, sizeof(long long));
+	long long count;
+
+	if (!tally) {
+		fprintf(stderr, " failed to allocate %lld counters. No memory\n", nchunks + 1);
+		exit(1);
+	}
+	count = scan_ranges(&mq->q, ts, n, nthreads, NULL, tally);
+
+	for (int i = 0; i < mq->nqueries; i++) counts[i] = 0;
+	for (long long c = 0; c < nchunks; c++) {
+		if (!tally[c]) continue;
+		for (long long d = c; d >= 0; d = mq->next[d]) counts[mq->owner[d]] += tally[c];
+	}
+	free(tally);
+	return count;
+}
+
+/* rk_scan_parallel() over a to-be-matched document that is read from fd
+	 RK_STREAM_CHUNK bytes at a time and normalized on the fly, so it is never
+	 held in memory as a whole. The last k-1 normalized bytes of each piece
+	 are carried over to the next one so that chunks straddling two pieces are
+	 still found. Return -1 if reading fd fails.
+	 Unless hits is NULL, the matches are added to it as in
+	 rk_scan_parallel(), and handed to hits->flush, if set, after each piece. */
+long long
+rk_scan_stream(const rk_query *q, /* built by rk_build_query() */
+               int fd,            /* to-be-matched document (Y) */
+               int nthreads,      /* number of threads scanning each piece */
+               rk_hits *hits      /* matches, NULL if not recorded */)
+{
+	int k = q->k;
+	normalize_state st;
+	char *raw = malloc(RK_STREAM_CHUNK);
+	char *win = malloc(k + RK_STREAM_CHUNK + 1);
+	long long have = 0;	/* normalized bytes in win */
+	long long off = 0;	/* offset of win in the normalized document */
+	long long count = 0;
+	ssize_t n;
+
+	if (!raw || !win) {
+		fprintf(stderr, " failed to allocate %d bytes. No memory\n", 2*RK_STREAM_CHUNK + k + 1);
+		exit(1);
+	}
+
+	normalize_stream_init(&st);
+	while ((n = read(fd, raw, RK_STREAM_CHUNK)) > 0) {
+		have += normalize_stream(&st, raw, n, win + have);
+		if (have < k) continue;
+
+		if (hits) hits->base = off;
+		count += rk_scan_parallel(q, win, have, nthreads, hits);
+		if (hits && hits->flush) hits->flush(hits, hits->arg);
+		memmove(win, win + have - (k-1), k-1);
+		off += have - (k-1);
+		have = k-1;
+	}
+	if (n < 0) {
+		perror("rk_scan_stream: read ");
+		count = -1;
+	}
+
+	free(raw);
+	free(win);
+	return count;
+}
@@ -0,0 +1,118 @@
+/***********************************************************
+ File Name: rk.h
+ Description: definition of the matching algorithms of rkmatch
+ **********************************************************/
+#ifndef RK_H
+#define RK_H
+
+#include "bloom.h"
+#include "hashtab.h"
+
+/* RK hash modulus and base */
+extern long long BIG_PRIME;
+extern long long asc;
+
+/* constants used for printing debug information */
+extern const int PRINT_RK_HASH;
+extern const int PRINT_BLOOM_BITS;
+
+long long madd(long long a, long long b);
+long long mdel(long long a, long long b);
+long long mmul(long long a, long long b);
+long long rk_power(int e);
+int rk_set_modulus(long long p);
+void rk_init(void);
+long long calculate(const char *ps, int k);
+void rk_hash_positions(int k, const char *ts, long long n, long long *out);
+
+int simple_match(const char *ps, int k, const char *ts, long long n);
+
+/* Individual simple_match() kernels, exposed for testing and benchmarking.
+   simple_match_kernel() returns NULL if the named kernel ("scalar",
+   "sse2", "avx2") is not supported on this machine. */
+typedef int (*match_fn)(const char *ps, int k, const char *ts, long long n);
+int simple_match_scalar(const char *ps, int k, const char *ts, long long n);
+match_fn simple_match_kernel(const char *name);
+int rabin_karp_match(const char *ps, int k, const char *ts, long long n);
+
+/* counters of the batch matcher's scans (rkmatch -s) */
+typedef struct {
+	long long probes;        /* chunk positions looked up */
+	long long hits;          /* positions passing the bloom filter */
+	long long matches;       /* positions whose chunk is one of the query */
+	long long verify_bytes;  /* bytes compared verifying the hits */
+} rk_stats;
+
+/* the query side of the batch matcher (see rk_build_query()) */
+typedef struct {
+	int k;
+	const char *qs;       /* normalized query document */
+	long long m;          /* its length */
+	bloom_filter filter;  /* pre-filter, buf is NULL if not used */
+	hashtab chunks;       /* RK hash -> offset of each distinct chunk of qs */
+	long long out[256];   /* c * asc^k: byte c leaving the rolling window */
+	rk_stats *stats;      /* counters the scans add to, NULL for none */
+} rk_query;
+
+rk_query rk_build_query(bloom_filter filter, int k, const char *qs, long long m);
+void rk_free_query(rk_query *q);
+int rk_save_query(const rk_query *q, const char *fname);
+int rk_load_query(const char *fname, rk_query *q, int *k, long long *modulus);
+
+long long rk_scan(const rk_query *q, const char *ts, long long n);
+
+/* a match of the batch matcher: the chunk of the query at qoff (the first
+   one with that text) is at toff in the normalized target */
+typedef struct {
+	long long toff;
+	long long qoff;
+} rk_hit;
+
+/* Matches recorded by the scans, in target order. If flush is set, the
+   streaming scan hands the list to it after every piece; flush is
+   expected to write the matches out and empty the list. */
+typedef struct rk_hits {
+	rk_hit *v;
+	long long n, cap;
+	long long base;    /* offset in the target of the text being scanned */
+	void (*flush)(struct rk_hits *h, void *arg);
+	void *arg;
+} rk_hits;
+
+void rk_hits_init(rk_hits *h);
+void rk_hits_add(rk_hits *h, long long toff, long long qoff);
+void rk_hits_free(rk_hits *h);
+long long rk_scan_hits(const rk_query *q, const char *ts, long long n, rk_hits *hits);
+
+/* Rolling hash kernels, exposed for testing and benchmarking.
+   rk_roll_kernel() returns NULL if the named kernel ("scalar", "avx2",
+   "avx512") is not supported on this machine. */
+#define RK_LANES 32
+typedef void (*rk_roll_fn)(long long *h, const long long *d, int steps, long long *hashes);
+rk_roll_fn rk_roll_kernel(const char *name);
+void rk_hash_all(const rk_query *q, rk_roll_fn fn, const char *ts, long long n, long long *out);
+int rk_verify(const rk_query *q, long long h, const char *t);
+void rk_run_jobs(void *(*fn)(void *), void *jobs, size_t size, int njobs);
+long long rk_scan_parallel(const rk_query *q, const char *ts, long long n, int nthreads, rk_hits *hits);
+long long rk_scan_stream(const rk_query *q, int fd, int nthreads, rk_hits *hits);
+void rk_scan_ks(const rk_query *q, int nk, const char *ts, long long n, int nthreads, long long *counts);
+
+/* the query side of the batch matcher for several queries at once (see
+   rk_build_multi()) */
+typedef struct {
+	rk_query q;           /* chunks of all queries, q.qs their concatenation */
+	int nqueries;
+	long long *first;     /* first chunk of each query, then the number of chunks */
+	int *owner;           /* query of each chunk */
+	long long *next;      /* next chunk of another query with the same text, -1 for none */
+} rk_multi;
+
+long long rk_scan_tally(const rk_query *q, const char *ts, long long n, long long *tally);
+rk_multi rk_build_multi(bloom_filter filter, int k, const char **qs, const long long *m, int nq);
+void rk_free_multi(rk_multi *mq);
+long long rk_scan_multi(const rk_multi *mq, const char *ts, long long n, int nthreads, long long *counts);
+
+long long rabin_karp_batchmatch(long long bsz, int k, const char *qs, long long m,
+                                const char *ts, long long n, int nthreads);
+
+#endif
@@ -0,0 +1,896 @@
+/***********************************************************
+ File Name: rkbench.c
+ Description: micro-benchmarks for the rkmatch building blocks
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "normalize.h"
+#include "rk.h"
+#include "ac.h"
+#include "doc.h"
+#include "proto.h"
+#include "minhash.h"
+#include "kindex.h"
+
+/* time stamp counter, 0 where there is none */
+static unsigned long long
+rdtsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fill buf with len bytes of denormalized text in the style of rktest.py:
+   random lower/upper case words separated by runs of white-space.
+   A space starts a new word with probability 1/space_every. */
+static void
+gen_text(char *buf, long long len, int space_every)
+{
+	long long i = 0;
+	int wlen = 0;
+
+	while (i < len) {
+		if (random() % space_every == 0 || wlen > 14 * space_every / 10) {
+			buf[i++] = ' ';
+			if (i < len) buf[i++] = '\t';
+			for (int j = 0; j < 3 && i < len; j++) {
+				if (random() & 1) buf[i++] = ' ';
+			}
+			wlen = 0;
+		} else {
+			char c = 'a' + random() % 26;
+			buf[i++] = (random() & 1) ? c - 'a' + 'A' : c;
+			wlen++;
+		}
+	}
+}
+
+static int
+bench_normalize(int argc, char **argv)
+{
+	const char *kernels[] = { "scalar", "sse2", "avx2" };
+	const struct { const char *name; int space_every; } inputs[] = {
+		{ "ws-dense", 10 },   /* rktest.py style Y documents */
+		{ "ws-sparse", 200 },
+	};
+	long long len = (argc > 0 ? atoll(argv[0]) : 64) << 20;
+	int reps = argc > 1 ? atoi(argv[1]) : 5;
+	char *src = malloc(len), *ref = malloc(len), *work = malloc(len);
+
+	if (!src || !ref || !work) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", len);
+		exit(1);
+	}
+
+	for (int in = 0; in < 2; in++) {
+		long long ref_len;
+
+		srandom(1);
+		gen_text(src, len, inputs[in].space_every);
+		memcpy(ref, src, len);
+		ref_len = normalize_scalar(ref, len);
+
+		for (int kn = 0; kn < 3; kn++) {
+			normalize_fn fn = normalize_kernel(kernels[kn]);
+			double best = 1e30;
+			long long out_len = 0;
+
+			if (!fn) {
+				printf("%-10s %-7s unsupported\n", inputs[in].name, kernels[kn]);
+				continue;
+			}
+			for (int r = 0; r < reps; r++) {
+				double t;
+				memcpy(work, src, len);
+				t = now_sec();
+				out_len = fn(work, len);
+				t = now_sec() - t;
+				if (t < best) best = t;
+			}
+			if (out_len != ref_len || memcmp(work, ref, ref_len) != 0) {
+				printf("%s: %s output differs from scalar\n", inputs[in].name, kernels[kn]);
+				exit(1);
+			}
+			printf("%-10s %-7s %8.3f GB/s (%lld -> %lld bytes)\n", inputs[in].name,
+			       kernels[kn], len / best / 1e9, len, out_len);
+		}
+	}
+
+	free(src);
+	free(ref);
+	free(work);
+	return 0;
+}
+
+/* simple_match() kernels over a normalized target: 32 query chunks of
+   each length, half of them copied from the target (found after scanning
+   part of it) and half random (not found, a full scan). Throughput counts
+   the target bytes each chunk would scan without an early exit. */
+static int
+bench_match(int argc, char **argv)
+{
+	const char *kernels[] = { "scalar", "sse2", "avx2" };
+	const int ks[] = { 8, 20, 100 };
+	long long n = (argc > 0 ? atoll(argv[0]) : 16) << 20;
+	int reps = argc > 1 ? atoi(argv[1]) : 3;
+	int nchunks = 32;
+	char *ts = malloc(n), *qs = malloc(nchunks * 100 * 2);
+
+	if (!ts || !qs) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", n);
+		exit(1);
+	}
+	srandom(1);
+	gen_text(ts, n, 10);
+	n = normalize(ts, n);
+
+	for (int ki = 0; ki < 3; ki++) {
+		int k = ks[ki];
+		long long m, ref = -1;
+
+		gen_text(qs, nchunks * 100 * 2, 10);
+		m = normalize(qs, nchunks * 100 * 2);
+		for (int c = 0; c < nchunks; c += 2) memcpy(qs + c * k, ts + random() % (n - k), k);
+
+		for (int kn = 0; kn < 3; kn++) {
+			match_fn fn = simple_match_kernel(kernels[kn]);
+			double best = 1e30;
+			long long found = 0;
+
+			if (!fn) {
+				printf("k=%-4d %-7s unsupported\n", k, kernels[kn]);
+				continue;
+			}
+			for (int r = 0; r < reps; r++) {
+				double t = now_sec();
+				found = 0;
+				for (int c = 0; c < nchunks && (c + 1) * k <= m; c++) found += fn(qs + c * k, k, ts, n);
+				t = now_sec() - t;
+				if (t < best) best = t;
+			}
+			if (ref < 0) ref = found;
+			if (found != ref) {
+				printf("k=%d: %s finds %lld chunks, scalar %lld\n", k, kernels[kn], found, ref);
+				exit(1);
+			}
+			printf("k=%-4d %-7s %8.3f GB/s (%lld of %d chunks found)\n", k, kernels[kn],
+			       (double)nchunks * n / best / 1e9, found, nchunks);
+		}
+	}
+
+	free(ts);
+	free(qs);
+	return 0;
+}
+
+/* Rolling hash kernels: all chunk hashes of a normalized target, one
+   after the other ("serial") and by each lane-parallel kernel, verified
+   against the serial ones. Reports bytes per TSC cycle and GB/s. */
+static int
+bench_roll(int argc, char **argv)
+{
+	const char *kernels[] = { "serial", "scalar", "avx2", "avx512" };
+	long long n = (argc > 0 ? atoll(argv[0]) : 64) << 20;
+	int reps = argc > 1 ? atoi(argv[1]) : 5;
+	int k = argc > 2 ? atoi(argv[2]) : 20;
+	char *ts = malloc(n);
+	long long *ref = malloc(n * sizeof(long long)), *out = malloc(n * sizeof(long long));
+	rk_query q;
+
+	if (!ts || !ref || !out) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", n * 17);
+		exit(1);
+	}
+	srandom(1);
+	gen_text(ts, n, 10);
+	n = normalize(ts, n);
+	q = rk_build_query((bloom_filter){ 0 }, k, ts, k);
+
+	for (int kn = 0; kn < 4; kn++) {
+		rk_roll_fn fn = kn == 0 ? NULL : rk_roll_kernel(kernels[kn]);
+		double best = 1e30;
+		unsigned long long cycles = ~0ULL;
+
+		if (kn > 0 && !fn) {
+			printf("%-7s unsupported\n", kernels[kn]);
+			continue;
+		}
+		for (int r = 0; r < reps; r++) {
+			unsigned long long c = rdtsc();
+			double t = now_sec();
+			rk_hash_all(&q, fn, ts, n, kn == 0 ? ref : out);
+			t = now_sec() - t;
+			c = rdtsc() - c;
+			if (t < best) best = t;
+			if (c < cycles) cycles = c;
+		}
+		if (kn > 0 && memcmp(out, ref, (n - k + 1) * sizeof(long long)) != 0) {
+			printf("%s: hashes differ from serial\n", kernels[kn]);
+			exit(1);
+		}
+		printf("%-7s %6.3f bytes/cycle %8.3f GB/s (k=%d)\n", kernels[kn],
+		       (double)n / cycles, n / best / 1e9, k);
+	}
+
+	rk_free_query(&q);
+	free(ts);
+	free(ref);
+	free(out);
+	return 0;
+}
+
+/* Multi-pattern matching of all m/k query chunks in one pass over the
+   target: the Aho-Corasick automaton (-t 3) against the bloom filter
+   batch matcher (-t 2), across chunk lengths and query sizes. The first
+   half of each query is taken from the end of the target so that there
+   are matches but the automaton cannot stop early. */
+static int
+bench_multi(int argc, char **argv)
+{
+	const int ks[] = { 20, 50, 100 };
+	const long long qsizes[] = { 16 << 10, 256 << 10, 4 << 20 };
+	long long n = (argc > 0 ? atoll(argv[0]) : 64) << 20;
+	int reps = argc > 1 ? atoi(argv[1]) : 3;
+	long long qmax = qsizes[2];
+	char *ts = malloc(n), *qs = malloc(qmax);
+
+	if (!ts || !qs) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", n + qmax);
+		exit(1);
+	}
+	srandom(1);
+	gen_text(ts, n, 10);
+	n = normalize(ts, n);
+
+	printf("%-4s %-9s %-9s %10s %10s %12s\n", "k", "query", "algo", "build ms", "scan MB/s", "matched");
+	for (int qi = 0; qi < 3; qi++) {
+		long long m = qsizes[qi];
+
+		gen_text(qs, qmax, 10);
+		m = normalize(qs, m);
+		memcpy(qs, ts + n - m / 2, m / 2);
+
+		for (int ki = 0; ki < 3; ki++) {
+			int k = ks[ki];
+			double build[2] = { 1e30, 1e30 }, scan[2] = { 1e30, 1e30 };
+			long long matched[2] = { 0, 0 };
+
+			for (int r = 0; r < reps; r++) {
+				ac_automaton a;
+				rk_query q;
+				double t0, t1, t2;
+
+				t0 = now_sec();
+				ac_build(&a, qs, m, k);
+				t1 = now_sec();
+				matched[0] = ac_match(&a, ts, n);
+				t2 = now_sec();
+				ac_free(&a);
+				if (t1 - t0 < build[0]) build[0] = t1 - t0;
+				if (t2 - t1 < scan[0]) scan[0] = t2 - t1;
+
+				t0 = now_sec();
+				q = rk_build_query(bloom_init_fpr(m / k, 0.01, BLOOM_BLOCKED, 0), k, qs, m);
+				t1 = now_sec();
+				matched[1] = rk_scan(&q, ts, n);
+				t2 = now_sec();
+				rk_free_query(&q);
+				if (t1 - t0 < build[1]) build[1] = t1 - t0;
+				if (t2 - t1 < scan[1]) scan[1] = t2 - t1;
+			}
+			for (int i = 0; i < 2; i++) {
+				printf("%-4d %-9lld %-9s %10.2f %10.1f %12lld\n", k, m, i == 0 ? "ahocor" : "rkbatch",
+				       build[i] * 1e3, n / scan[i] / 1e6, matched[i]);
+			}
+		}
+	}
+
+	free(ts);
+	free(qs);
+	return 0;
+}
+
+/* Inputs of the suite come from their own generator (splitmix64) so that
+   they are the same with every C library */
+static unsigned long long suite_state;
+
+static unsigned long long
+suite_rand(void)
+{
+	unsigned long long z = (suite_state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* uniform in [0, 1) */
+static double
+suite_uniform(void)
+{
+	return (suite_rand() >> 11) * (1.0 / (1ULL << 53));
+}
+
+/* get_rand_string() of rktest.py: lower case words of at most 15 letters,
+   each character a space with probability 0.1 */
+static void
+gen_rand_string(char *buf, long long len)
+{
+	int wlen = 0;
+
+	for (long long i = 0; i < len; i++) {
+		if (suite_uniform() < 0.1 || wlen > 14) {
+			buf[i] = ' ';
+			wlen = 0;
+		} else {
+			buf[i] = 'a' + suite_rand() % 26;
+			wlen++;
+		}
+	}
+}
+
+/* get_denormalized() of rktest.py: every character upper case with
+   probability 1/2, every space followed by a tab and up to 3 more spaces.
+   dst needs room for 5*len bytes. Return the length of dst. */
+static long long
+gen_denormalized(const char *src, long long len, char *dst)
+{
+	long long n = 0;
+
+	for (long long i = 0; i < len; i++) {
+		dst[n++] = suite_uniform() < 0.5 ? src[i] : toupper((unsigned char)src[i]);
+		if (src[i] == ' ') {
+			dst[n++] = '\t';
+			for (int j = 0; j < 3; j++) {
+				if (suite_uniform() < 0.5) dst[n++] = ' ';
+			}
+		}
+	}
+	return n;
+}
+
+static int
+cmp_double(const void *x, const void *y)
+{
+	double a = *(const double *)x, b = *(const double *)y;
+	return a < b ? -1 : a > b;
+}
+
+struct suite_out {
+	FILE *f;
+	int json;
+	int rows;  /* rows written so far */
+};
+
+/* Write the row of one phase of one configuration: median and p99
+   (nearest rank) of the reps times t, which are sorted, and the median
+   throughput over the given number of bytes */
+static void
+suite_row(struct suite_out *o, const char *algo, const char *phase, int k, long long m,
+          long long n, const char *filter, double *t, int reps, long long bytes, long long matched)
+{
+	double med, p99;
+
+	qsort(t, reps, sizeof(double), cmp_double);
+	med = reps % 2 ? t[reps / 2] : (t[reps / 2 - 1] + t[reps / 2]) / 2;
+	p99 = t[(99 * reps + 99) / 100 - 1];
+	if (o->json) {
+		fprintf(o->f, "%s  {\"algo\": \"%s\", \"phase\": \"%s\", \"k\": %d, \"m\": %lld, \"n\": %lld, "
+		        "\"filter\": \"%s\", \"reps\": %d, \"median_ms\": %.3f, \"p99_ms\": %.3f, "
+		        "\"mb_per_s\": %.1f, \"matched\": %lld}", o->rows ? ",\n" : "[\n", algo, phase, k, m, n,
+		        filter, reps, med * 1e3, p99 * 1e3, bytes / med / 1e6, matched);
+	} else {
+		if (!o->rows) fprintf(o->f, "algo,phase,k,m,n,filter,reps,median_ms,p99_ms,mb_per_s,matched\n");
+		fprintf(o->f, "%s,%s,%d,%lld,%lld,%s,%d,%.3f,%.3f,%.1f,%lld\n", algo, phase, k, m, n,
+		        filter, reps, med * 1e3, p99 * 1e3, bytes / med / 1e6, matched);
+	}
+	o->rows++;
+}
+
+/* scan work (m/k chunks times n bytes) above which SIMPLE and RK, which
+   scan the target once per chunk, are left out */
+#define SUITE_SIMPLE_WORK (1LL << 31)
+#define SUITE_RK_WORK (1LL << 26)
+
+/* pre-filters of the RKBATCH configurations */
+static bloom_filter
+suite_filter(int which, long long m, int k)
+{
+	switch (which) {
+	case 1:  /* the classic filter of rkmatch: 10 bits and hashes per chunk */
+		return bloom_init_type(((m * 10 / k) >> 3) << 3, BLOOM_STANDARD);
+	case 2:
+		return bloom_init_fpr(m / k, 0.01, BLOOM_BLOCKED, 0);
+	case 3:
+		return bloom_init_fpr(m / k, 0.0001, BLOOM_STANDARD, 0);
+	default: /* exact index only (-B) */
+		return (bloom_filter){ 0 };
+	}
+}
+
+/* Regression suite of SIMPLE (-t 0), RK (-t 1) and RKBATCH (-t 2) across
+   chunk lengths k, query sizes m, target sizes n and pre-filters. The
+   documents are generated like rktest.py does, the first half of the query
+   being copied from the target, and denormalized. Every configuration is
+   run reps times; each phase is reported with its median and p99 time and
+   its median throughput:
+     normalize   both documents
+     preprocess  rk_build_query() (RKBATCH)
+     scan        SIMPLE and RK matching every chunk; for RKBATCH the hashes
+                 of all target positions and their bloom filter probes
+     verify      exact check of the positions passing the filter (RKBATCH)
+     total       rk_scan() doing scan and verify block by block (RKBATCH)
+   The RKBATCH scan and verify must count what rk_scan() counts, and RK
+   what SIMPLE counts. */
+static int
+bench_suite(int argc, char **argv)
+{
+	const int ks[] = { 20, 100 };
+	const long long ms[] = { 4 << 10, 64 << 10 };
+	const long long ns[] = { 1 << 20, 8 << 20 };
+	const char *filters[] = { "none", "classic", "blocked-1%", "standard-0.01%" };
+	int reps = argc > 0 ? atoi(argv[0]) : 5;
+	struct suite_out o = { NULL, argc > 1 && strcmp(argv[1], "json") == 0 };
+	long long nmax = ns[1], mmax = ms[1];
+	char *tsrc = malloc(nmax), *qsrc = malloc(mmax);
+	char *tden = malloc(5 * nmax), *qden = malloc(5 * mmax);
+	char *ts = malloc(5 * nmax), *qs = malloc(5 * mmax);
+	long long *hashes = malloc(nmax * sizeof(long long));
+	uint8_t *pass = malloc(nmax);
+	double *t[5];
+	rk_roll_fn roll = rk_roll_kernel("avx512");
+
+	if (reps < 1) reps = 1;
+	for (int p = 0; p < 5; p++) t[p] = malloc(reps * sizeof(double));
+	if (!tsrc || !qsrc || !tden || !qden || !ts || !qs || !hashes || !pass || !t[4]) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", 21 * nmax);
+		exit(1);
+	}
+	if (!roll) roll = rk_roll_kernel("avx2");
+	if (!roll) roll = rk_roll_kernel("scalar");
+
+	/* rabin_karp_match() prints hashes on the standard output: the results
+	   go to a copy of it, the prints to /dev/null */
+	o.f = fdopen(dup(STDOUT_FILENO), "w");
+	if (!o.f || !freopen("/dev/null", "w", stdout)) {
+		perror("stdout ");
+		exit(1);
+	}
+
+	for (int ni = 0; ni < 2; ni++) {
+		for (int mi = 0; mi < 2; mi++) {
+			long long n0, m0, n, m;
+
+			suite_state = 1;
+			gen_rand_string(tsrc, ns[ni]);
+			gen_rand_string(qsrc, ms[mi]);
+			memcpy(qsrc, tsrc + suite_rand() % (ns[ni] - ms[mi]), ms[mi] / 2);
+			n0 = gen_denormalized(tsrc, ns[ni], tden);
+			m0 = gen_denormalized(qsrc, ms[mi], qden);
+
+			for (int r = 0; r < reps; r++) {
+				double t0;
+
+				memcpy(ts, tden, n0);
+				memcpy(qs, qden, m0);
+				t0 = now_sec();
+				n = normalize(ts, n0);
+				m = normalize(qs, m0);
+				t[0][r] = now_sec() - t0;
+			}
+			suite_row(&o, "-", "normalize", 0, m, n, "-", t[0], reps, n0 + m0, 0);
+
+			for (int ki = 0; ki < 2; ki++) {
+				int k = ks[ki];
+				long long nchunks = m / k, matched = -1;
+
+				if (nchunks * n <= SUITE_SIMPLE_WORK) {
+					for (int r = 0; r < reps; r++) {
+						double t0 = now_sec();
+						matched = 0;
+						for (long long i = 0; i + k <= m; i += k) matched += simple_match(qs + i, k, ts, n);
+						t[1][r] = now_sec() - t0;
+					}
+					suite_row(&o, "simple", "scan", k, m, n, "-", t[1], reps, n, matched);
+				}
+				if (nchunks * n <= SUITE_RK_WORK) {
+					long long rk_matched = 0;
+
+					for (int r = 0; r < reps; r++) {
+						double t0 = now_sec();
+						rk_matched = 0;
+						for (long long i = 0; i + k <= m; i += k) rk_matched += rabin_karp_match(qs + i, k, ts, n);
+						t[1][r] = now_sec() - t0;
+					}
+					if (matched >= 0 && rk_matched != matched) {
+						fprintf(stderr, "k=%d m=%lld n=%lld: rk matches %lld chunks, simple %lld\n",
+						        k, m, n, rk_matched, matched);
+						exit(1);
+					}
+					suite_row(&o, "rk", "scan", k, m, n, "-", t[1], reps, n, rk_matched);
+				}
+
+				for (int fi = 0; fi < 4; fi++) {
+					long long total = 0, count = 0, npos = n - k + 1;
+
+					for (int r = 0; r < reps; r++) {
+						double t0, t1, t2, t3;
+						rk_query q;
+
+						t0 = now_sec();
+						q = rk_build_query(suite_filter(fi, m, k), k, qs, m);
+						t1 = now_sec();
+						total = rk_scan(&q, ts, n);
+						t2 = now_sec();
+						rk_hash_all(&q, roll, ts, n, hashes);
+						if (q.filter.buf) {
+							bloom_query_batch(q.filter, hashes, npos, pass);
+						} else {
+							memset(pass, 1, npos);
+						}
+						t3 = now_sec();
+						count = 0;
+						for (long long i = 0; i < npos; i++) {
+							if (pass[i]) count += rk_verify(&q, hashes[i], ts + i);
+						}
+						t[4][r] = now_sec() - t3;
+						t[1][r] = t1 - t0;
+						t[2][r] = t2 - t1;
+						t[3][r] = t3 - t2;
+						rk_free_query(&q);
+					}
+					if (count != total) {
+						fprintf(stderr, "k=%d m=%lld n=%lld %s: scan and verify count %lld, rk_scan %lld\n",
+						        k, m, n, filters[fi], count, total);
+						exit(1);
+					}
+					suite_row(&o, "rkbatch", "preprocess", k, m, n, filters[fi], t[1], reps, m, total);
+					suite_row(&o, "rkbatch", "scan", k, m, n, filters[fi], t[3], reps, n, total);
+					suite_row(&o, "rkbatch", "verify", k, m, n, filters[fi], t[4], reps, n, total);
+					suite_row(&o, "rkbatch", "total", k, m, n, filters[fi], t[2], reps, n, total);
+				}
+			}
+		}
+	}
+	if (o.json) fprintf(o.f, "\n]\n");
+	fclose(o.f);
+
+	free(tsrc);
+	free(qsrc);
+	free(tden);
+	free(qden);
+	free(ts);
+	free(qs);
+	free(hashes);
+	free(pass);
+	for (int p = 0; p < 5; p++) free(t[p]);
+	return 0;
+}
+
+/* bytes copied from the target at a time into the queries of bench_sketch() */
+#define SKETCH_PIECE 4096
+
+/* Accuracy and speed of the MinHash sketches (rkmatch -t 5) against the
+   exact batch matcher (-t 2). Each query is made of pieces of the target
+   for a share of its length and of other text for the rest; queries as
+   large as the target and 16 times smaller are tried. For each sketch
+   size the table gives the share of query chunks -t 2 finds and the time
+   it takes (build and scan), the estimated containment, its error and
+   sample, the estimated Jaccard similarity, the time to sketch the target
+   and the time to compare two sketches. */
+static int
+bench_sketch(int argc, char **argv)
+{
+	const double shares[] = { 0, 0.1, 0.5, 0.9, 1 };
+	const int sizes[] = { 64, 256, 1024 };
+	long long n = (argc > 0 ? atoll(argv[0]) : 16) << 20;
+	int reps = argc > 1 ? atoi(argv[1]) : 3;
+	int k = argc > 2 ? atoi(argv[2]) : 50;
+	char *ts = malloc(n), *qs = malloc(n), *other = malloc(n);
+
+	if (!ts || !qs || !other) {
+		fprintf(stderr, "failed to allocate %lld bytes. No memory\n", 3 * n);
+		exit(1);
+	}
+	srandom(1);
+	gen_text(ts, n, 10);
+	n = normalize(ts, n);
+	gen_text(other, n, 10);
+	normalize(other, n);
+
+	printf("%-6s %-9s %-6s %8s %10s %9s %7s %8s %8s %11s %11s\n", "size", "query", "share", "exact",
+	       "exact ms", "estimate", "error", "samples", "jaccard", "sketch ms", "compare us");
+	for (int mi = 0; mi < 2; mi++) {
+		long long m = mi == 0 ? n : n / 16;
+
+		for (int si = 0; si < 5; si++) {
+			double exact_t = 1e30, frac;
+			long long matched = 0;
+
+			/* each piece of the query is the piece at the same offset of
+			   the target, with probability share, or of the other text, so
+			   that no k-gram is repeated */
+			for (long long i = 0; i < m; i += SKETCH_PIECE) {
+				long long len = m - i < SKETCH_PIECE ? m - i : SKETCH_PIECE;
+
+				memcpy(qs + i, (double)random() / RAND_MAX < shares[si] ? ts + i : other + i, len);
+			}
+			for (int r = 0; r < reps; r++) {
+				double t0 = now_sec();
+				rk_query q = rk_build_query(bloom_init_fpr(m / k, 0.01, BLOOM_BLOCKED, 0), k, qs, m);
+
+				matched = rk_scan(&q, ts, n);
+				rk_free_query(&q);
+				if (now_sec() - t0 < exact_t) exact_t = now_sec() - t0;
+			}
+			frac = (double)matched / (m / k);
+
+			for (int zi = 0; zi < 3; zi++) {
+				double sketch_t = 1e30, cmp_t, t0, est = 0, jac = 0;
+				int samples = 0, ncmp = 10000;
+				minhash a, b;
+
+				minhash_build(&a, qs, m, k, sizes[zi]);
+				for (int r = 0; r < reps; r++) {
+					t0 = now_sec();
+					minhash_build(&b, ts, n, k, sizes[zi]);
+					if (now_sec() - t0 < sketch_t) sketch_t = now_sec() - t0;
+					if (r < reps - 1) minhash_free(&b);
+				}
+				t0 = now_sec();
+				for (int c = 0; c < ncmp; c++) {
+					est += minhash_containment(&a, &b, &samples);
+					jac += minhash_jaccard(&a, &b);
+				}
+				cmp_t = (now_sec() - t0) / ncmp;
+				est /= ncmp;
+				jac /= ncmp;
+				printf("%-6d %-9lld %-6.2f %8.3f %10.1f %9.3f %7.3f %8d %8.3f %11.1f %11.2f\n", sizes[zi], m,
+				       shares[si], frac, exact_t * 1e3, est, est - frac, samples, jac, sketch_t * 1e3,
+				       cmp_t * 1e6);
+				minhash_free(&a);
+				minhash_free(&b);
+			}
+		}
+	}
+
+	free(ts);
+	free(qs);
+	free(other);
+	return 0;
+}
+
+/* one client of the serve benchmark */
+struct serve_client {
+	const char *path;      /* socket of the server */
+	proto_request req;
+	const char *qs;        /* query text */
+	size_t m;
+	int nreq;
+	double *lat;           /* latency of each request */
+	int failed;
+};
+
+static void *
+serve_client(void *arg)
+{
+	struct serve_client *c = arg;
+	int fd = proto_connect(c->path);
+
+	c->failed = fd < 0;
+	for (int r = 0; r < c->nreq && !c->failed; r++) {
+		proto_reply rep;
+		char *body;
+		size_t blen;
+		double t0 = now_sec();
+
+		if (proto_send(fd, &c->req, sizeof(c->req), c->qs, c->m) != 0
+		    || proto_recv(fd, &rep, sizeof(rep), &body, &blen) != 0) {
+			fprintf(stderr, "serve: connection lost\n");
+			c->failed = 1;
+			break;
+		}
+		c->lat[r] = now_sec() - t0;
+		if (rep.status != PROTO_OK) {
+			fprintf(stderr, "serve: %s", body);
+			c->failed = 1;
+		}
+		free(body);
+	}
+	if (fd >= 0) close(fd);
+	return NULL;
+}
+
+/* Load generator of rkserve: clients connections in parallel, each sending
+   the requests of query_doc (its text) one after the other. Reports the
+   requests per second and the latency percentiles (nearest rank) over all
+   requests. */
+static int
+bench_serve(int argc, char **argv)
+{
+	int nclients = argc > 2 ? atoi(argv[2]) : 4;
+	int nreq = argc > 3 ? atoi(argv[3]) : 100;
+	proto_request req = { argc > 4 ? atoi(argv[4]) : 2, argc > 5 ? atoi(argv[5]) : 100, 0, 0 };
+	struct serve_client *c;
+	pthread_t *t;
+	double *lat, t0, secs, sum = 0;
+	long long total = (long long)nclients * nreq;
+	document q;
+	int failed = 0;
+
+	if (argc < 2 || nclients < 1 || nreq < 1) {
+		fprintf(stderr, "Usage: ./rkbench serve socket_path query_doc [clients] [requests] [algo] [k]\n");
+		return 1;
+	}
+	if (doc_read(argv[1], &q) != 0) return 1;
+	c = calloc(nclients, sizeof(*c));
+	t = calloc(nclients, sizeof(*t));
+	lat = calloc(total, sizeof(*lat));
+	if (!c || !t || !lat) {
+		fprintf(stderr, "failed to allocate %lld latencies. No memory\n", total);
+		exit(1);
+	}
+
+	t0 = now_sec();
+	for (int i = 0; i < nclients; i++) {
+		c[i] = (struct serve_client){ argv[0], req, q.buf, q.len, nreq, lat + (long long)i * nreq };
+		if (pthread_create(&t[i], NULL, serve_client, &c[i]) != 0) {
+			perror("pthread_create ");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < nclients; i++) {
+		pthread_join(t[i], NULL);
+		failed |= c[i].failed;
+	}
+	secs = now_sec() - t0;
+
+	if (!failed) {
+		for (long long i = 0; i < total; i++) sum += lat[i];
+		qsort(lat, total, sizeof(double), cmp_double);
+		printf("%-7s %-8s %-7s %-4s %10s %10s %10s %10s %10s\n", "clients", "requests", "algo", "k",
+		       "req/s", "mean ms", "p50 ms", "p99 ms", "max ms");
+		printf("%-7d %-8lld %-7d %-4d %10.1f %10.3f %10.3f %10.3f %10.3f\n", nclients, total, req.algo,
+		       req.k, total / secs, sum / total * 1e3, lat[(50 * total + 99) / 100 - 1] * 1e3,
+		       lat[(99 * total + 99) / 100 - 1] * 1e3, lat[total - 1] * 1e3);
+	}
+
+	free(lat);
+	free(t);
+	free(c);
+	doc_free(&q);
+	return failed;
+}
+
+/* Latency of a top-K query against an index built by rkindex: hashing
+   query_doc, then ranking the top 1, 10 and count documents, and every
+   document sharing a fingerprint (count = the number of documents, so the
+   long posting lists are counted in full). Best of the repetitions. */
+static int
+bench_topk(int argc, char **argv)
+{
+	int reps = argc > 3 ? atoi(argv[3]) : 5;
+	kindex x;
+	document q;
+	long long *hashes = NULL, nq = 0;
+	kindex_hit *hits;
+	int topks[4];
+	double hash_t = 1e30;
+
+	if (argc < 2 || reps < 1) {
+		fprintf(stderr, "Usage: ./rkbench topk index_file query_doc [count] [repetitions]\n");
+		return 1;
+	}
+	if (kindex_load(argv[0], &x) != 0) return 1;
+	if (x.ndocs < 1 || rk_set_modulus(x.modulus) != 0) {
+		fprintf(stderr, "%s: no documents or invalid modulus\n", argv[0]);
+		return 1;
+	}
+	if (doc_read(argv[1], &q) != 0) return 1;
+	doc_normalize(&q);
+	topks[0] = 1;
+	topks[1] = 10;
+	topks[2] = argc > 2 ? atoi(argv[2]) : 100;
+	topks[3] = x.ndocs > 1 << 30 ? 1 << 30 : x.ndocs;
+	hits = malloc(topks[3] * sizeof(kindex_hit));
+	if (!hits) {
+		fprintf(stderr, "failed to allocate %d hits. No memory\n", topks[3]);
+		exit(1);
+	}
+
+	for (int r = 0; r < reps; r++) {
+		double t0 = now_sec();
+
+		free(hashes);
+		nq = kindex_query_hashes(&x, q.buf, q.len, &hashes);
+		if (now_sec() - t0 < hash_t) hash_t = now_sec() - t0;
+	}
+	printf("index %lld documents %lld keys, query %lld bytes %lld fingerprints, hashed in %.3f ms\n",
+	       x.ndocs, x.nkeys, (long long)q.len, nq, hash_t * 1e3);
+	printf("%-10s %10s %10s %10s\n", "top", "found", "best", "rank ms");
+	for (int i = 0; i < 4; i++) {
+		int topk = topks[i] < topks[3] ? topks[i] : topks[3];
+		double best = 1e30;
+		long long n = 0;
+
+		if (topk < 1) continue;
+		for (int r = 0; r < reps; r++) {
+			double t0 = now_sec();
+
+			n = kindex_top(&x, hashes, nq, topk, hits);
+			if (now_sec() - t0 < best) best = now_sec() - t0;
+		}
+		printf("%-10d %10lld %10lld %10.3f\n", topk, n, n > 0 ? hits[0].matched : 0, best * 1e3);
+	}
+
+	free(hits);
+	free(hashes);
+	doc_free(&q);
+	kindex_free(&x);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2) {
+		printf("Usage:\n ./rkbench normalize [size_in_MB] [repetitions]\n"
+		       " ./rkbench match [target_size_in_MB] [repetitions]\n"
+		       " ./rkbench roll [target_size_in_MB] [repetitions] [k]\n"
+		       " ./rkbench multi [target_size_in_MB] [repetitions]\n"
+		       " ./rkbench suite [repetitions] [csv|json]\n"
+		       " ./rkbench sketch [target_size_in_MB] [repetitions] [k]\n"
+		       " ./rkbench serve socket_path query_doc [clients] [requests] [algo] [k]\n"
+		       " ./rkbench topk index_file query_doc [count] [repetitions]\n");
+		exit(1);
+	}
+
+	if (strcmp(argv[1], "normalize") == 0) {
+		return bench_normalize(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "match") == 0) {
+		return bench_match(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "roll") == 0) {
+		return bench_roll(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "multi") == 0) {
+		return bench_multi(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "suite") == 0) {
+		return bench_suite(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "sketch") == 0) {
+		return bench_sketch(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "serve") == 0) {
+		return bench_serve(argc - 2, argv + 2);
+	}
+	if (strcmp(argv[1], "topk") == 0) {
+		return bench_topk(argc - 2, argv + 2);
+	}
+
+	fprintf(stderr, "unknown benchmark '%s'\n", argv[1]);
+	return 1;
+}
@@ -0,0 +1,187 @@
+/* Build the k-gram index of a collection of documents doc1, doc2, ...
+
+	 ./rkindex [-k snippet_size] [-w window] [-j threads] [-l doc_list] -o index_file doc1 [doc2...]
+
+	 Every document is normalized and reduced to its winnowed fingerprints
+	 (see winnow.h), which are written to index_file with the documents
+	 they occur in. A directory given as a document stands for all files
+	 below it; doc_list names one more document per line. The documents
+	 are fingerprinted concurrently by the -j threads.
+
+	 ./rkmatch -I index_file query_doc
+
+	 then finds the indexed documents sharing fingerprints with query_doc.
+
+	 ./rkindex -A [-k snippet_size] [-w window] [-j threads] [-l doc_list] doc1 [doc2...]
+
+	 compares the documents with each other instead (-o may be given as
+	 well): for every pair sharing fingerprints, in document order, a line
+	 "doc_a doc_b: jaccard similar, shared X of A and B" gives the number X
+	 of distinct fingerprints they share, A and B those of each document and
+	 the Jaccard similarity X/(A+B-X) of their fingerprints. Pairs sharing
+	 nothing are not printed. -w 1 selects every k-gram as a fingerprint.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "normalize.h"
+#include "rk.h"
+#include "doc.h"
+#include "corpus.h"
+#include "winnow.h"
+#include "kindex.h"
+
+/* the fingerprints of one document, kept until it is added in corpus order */
+struct doc_fps {
+	long long len;
+	winnow_fp *fp;
+	long long nfp;
+};
+
+struct index_ctx {
+	int k;
+	int w;
+	kindex_builder b;
+	int failed;             /* some document could not be read */
+};
+
+/* Fingerprint the document fname into *data (struct doc_fps). Return its
+	 number of fingerprints, or -1 if it cannot be read. */
+static long long
+fingerprint_doc(const char *fname, void **data, void *arg)
+{
+	struct index_ctx *ctx = arg;
+	struct doc_fps *d;
+	document doc;
+
+	if (doc_read(fname, &doc) != 0) return -1;
+	doc_normalize(&doc);
+
+	d = malloc(sizeof(*d));
+	if (!d) {
+		fprintf(stderr, " failed to allocate the fingerprints of %s. No memory\n", fname);
+		exit(1);
+	}
+	d->len = doc.len;
+	d->nfp = winnow_fingerprints(doc.buf, doc.len, ctx->k, ctx->w, &d->fp);
+	doc_free(&doc);
+	*data = d;
+	return d->nfp;
+}
+
+/* add the fingerprints of fname to the index, so documents are numbered in
+	 corpus order */
+static void
+add_doc(const char *fname, long long nfp, void *data, void *arg)
+{
+	struct index_ctx *ctx = arg;
+	struct doc_fps *d = data;
+
+	if (nfp < 0) {
+		fprintf(stderr, "%s: skipped\n", fname);
+		ctx->failed = 1;
+		return;
+	}
+
+	kindex_builder_add(&ctx->b, fname, d->len, d->fp, d->nfp);
+	free(d->fp);
+	free(d);
+}
+
+/* Print the pairs of documents of b sharing fingerprints, counted by
+	 nthreads threads */
+static void
+print_pairs(kindex_builder *b, int nthreads)
+{
+	long long *distinct = malloc(b->ndocs * sizeof(long long));
+	kindex_pair *pairs;
+	long long n;
+
+	if (!distinct) {
+		fprintf(stderr, " failed to allocate %lld counters. No memory\n", b->ndocs);
+		exit(1);
+	}
+	n = kindex_builder_pairs(b, nthreads, distinct, &pairs);
+	for (long long i = 0; i < n; i++) {
+		long long x = pairs[i].shared, na = distinct[pairs[i].a], nb = distinct[pairs[i].b];
+
+		printf("%s %s: %.2f similar, shared %lld of %lld and %lld\n", b->names[pairs[i].a],
+		       b->names[pairs[i].b], (double)x / (na + nb - x), x, na, nb);
+	}
+	free(pairs);
+	free(distinct);
+}
+
+int
+main(int argc, char **argv)
+{
+	int k = 100; /* default match size is 100*/
+	int w = 0; /* winnowing window, 0 for k */
+	int nthreads = 1; /* threads fingerprinting the documents */
+	const char *out = NULL;
+	int all_pairs = 0; /* compare the documents with each other (-A) */
+	struct index_ctx ctx;
+	corpus docs;
+	int c;
+
+	corpus_init(&docs);
+
+	while ((c = getopt(argc, argv, "k:w:j:l:o:A")) != -1) {
+		switch (c)
+		{
+			case 'k':
+				k = atoi(optarg);
+				break;
+			case 'w':
+				w = atoi(optarg);
+				if (w < 1) {
+					fprintf(stderr, "Winnowing window must be at least 1\n");
+					exit(1);
+				}
+				break;
+			case 'j':
+				nthreads = atoi(optarg);
+				if (nthreads < 1) nthreads = 1;
+				break;
+			case 'l':
+				if (corpus_add_list(&docs, optarg) != 0) exit(1);
+				break;
+			case 'o':
+				out = optarg;
+				break;
+			case 'A':
+				all_pairs = 1;
+				break;
+			default:
+				fprintf(stderr,
+						"Valid options are: -k <match size> -w <winnowing window> -j <threads> -l <doc list file> -o <index file> -A (all pairs)\n");
+				exit(1);
+		}
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (corpus_add(&docs, argv[i]) != 0) exit(1);
+	}
+	if ((!out && !all_pairs) || docs.n < 1 || k < 1) {
+		printf("Usage: ./rkindex -o index_file doc1 [doc2...]\n"
+		       "       ./rkindex -A doc1 [doc2...]\n");
+		exit(1);
+	}
+
+	ctx = (struct index_ctx){ k, w > 0 ? w : k };
+	kindex_builder_init(&ctx.b, ctx.k, ctx.w);
+
+	/* the workers normalize and hash with tables set up here */
+	normalize_init();
+	rk_init();
+	corpus_run(&docs, nthreads, fingerprint_doc, add_doc, &ctx);
+	if (all_pairs) print_pairs(&ctx.b, nthreads);
+	if (out && kindex_save(&ctx.b, out) != 0) ctx.failed = 1;
+
+	kindex_builder_free(&ctx.b);
+	corpus_free(&docs);
+	return ctx.failed;
+}
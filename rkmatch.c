@@ -1,7 +1,62 @@
 /* Match every k-character snippet of the query_doc document
 	 among a collection of documents doc1, doc2, ....
 
-	 ./rkmatch snippet_size query_doc doc1 [doc2...]
+	 ./rkmatch [-t algo] [-k snippet_size] [-j threads] [-l doc_list] query_doc doc1 [doc2...]
+
+	 A directory given as a document stands for all files below it; doc_list
+	 names one more document per line. The query is processed once and the
+	 documents are matched concurrently by the -j threads.
+
+	 ./rkmatch -t 2 [-k snippet_size] -o filter_file query_doc
+	 ./rkmatch -t 2 -f filter_file doc1 [doc2...]
+
+	 The first form saves the bloom filter and chunk index of query_doc into
+	 filter_file; the second matches documents against a saved query without
+	 reading or hashing it again. Processes using the same filter file share
+	 its pages.
+
+	 With -t 2 -P first|all, every matched query chunk is also written as a
+	 line "query_offset target_offset" (offsets in the normalized documents),
+	 for the first or for every occurrence in the document, in target order,
+	 before the document's result line.
+
+	 -t 4 compares winnowed fingerprints instead of chunks: the minimum RK
+	 hash of every window of -w consecutive k-character hashes (-w defaults
+	 to k) is selected from both documents. The result is the number of
+	 query fingerprints that are fingerprints of the document too; any
+	 passage of at least w+k-1 characters in common is found.
+
+	 -t 5 estimates the overlap from MinHash sketches instead of counting
+	 matches: the -n (256 by default) smallest values of the k-character
+	 hashes of each document. The result line "fraction estimated (jaccard
+	 j, s samples)" gives the estimated share of the distinct k-grams of
+	 query_doc that are in the document, and the Jaccard similarity of the
+	 two sets of k-grams. The share is estimated from s sampled k-grams of
+	 the query, fewer when the document is much larger than the query.
+
+	 ./rkmatch -t 2 [-k snippet_size] [-j threads] -Q query_list target_doc
+
+	 matches each of the query documents named in query_list (one per line,
+	 directories stand for the files below them) against target_doc, whose
+	 hashes are computed once for all of them, and prints the result line
+	 of every query.
+
+	 ./rkmatch -I index_file query_doc
+
+	 looks the fingerprints (as in -t 4) of query_doc up in an index built
+	 by rkindex, and prints the result line of every indexed document that
+	 shares some; the corpus is not read. With -T count, only the count
+	 documents sharing the most fingerprints are printed, best first; the
+	 longest posting lists are then only merged with the documents that
+	 can still make it.
+
+	 With -t 2, -k may be a list of snippet sizes such as 20,50,100: each
+	 document is read, normalized and scanned once for all of them, and a
+	 result line "k=size: ..." is printed for every size.
+
+	 With -s, statistics of the run (time per phase and, for -t 2, the
+	 bloom filter and verification counters) are written to the standard
+	 error as JSON after the results.
 
 */
 
@@ -18,402 +73,695 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "bloom.h"
-
-enum algotype { SIMPLE = 0, RK, RKBATCH};
-
-/* a large prime for RK hash (BIG_PRIME*256 does not overflow)*/
-long long BIG_PRIME = 5003943032159437; 
-
-/* constants used for printing debug information */
-const int PRINT_RK_HASH = 5;
-const int PRINT_BLOOM_BITS = 160;
-long long int asc = 256;
-
-/* modulo addition */
-long long
-madd(long long a, long long b)
+#include "normalize.h"
+#include "doc.h"
+#include "corpus.h"
+#include "hashtab.h"
+#include "rk.h"
+#include "ac.h"
+#include "winnow.h"
+#include "kindex.h"
+#include "minhash.h"
+
+enum algotype { SIMPLE = 0, RK, RKBATCH, AHOCORASICK, WINNOW, SKETCH};
+
+/* largest bitmap for which hash_i() reaches every bit */
+#define RK_CLASSIC_MAX_BITS (1LL << 25)
+
+/* false positive rate of large filters when -p is not given */
+#define RK_DEFAULT_FPR 0.01
+
+/* most snippet sizes in a -k list */
+#define RK_MAX_KS 16
+
+/* values of a MinHash sketch when -n is not given */
+#define RK_DEFAULT_SKETCH 256
+
+/* phases timed with -s */
+enum phase { QUERY_READ = 0, QUERY_NORMALIZE, QUERY_HASHING, DOC_READ, DOC_NORMALIZE, DOC_SCAN, NPHASES };
+
+static const char *phase_names[NPHASES] = {
+	"query_read", "query_normalize", "query_hashing", "read", "normalize", "scan"
+};
+
+/* -P: which match positions are written */
+enum { POS_NONE = 0, POS_FIRST, POS_ALL };
+
+/* the match positions of one document, kept until it is reported */
+struct doc_hits {
+	rk_hits hits;
+	char *seen;              /* POS_FIRST: query chunks already matched */
+	int k;
+};
+
+/* what is matched against every document of the corpus */
+struct match_ctx {
+	int algo;
+	int k;
+	const char *qs;        /* normalized query document */
+	long long m;
+	rk_query query;        /* RKBATCH: query index built once from qs */
+	int nk;                /* RKBATCH: number of sizes of a -k list, 1 for one size */
+	rk_query kq[RK_MAX_KS]; /* RKBATCH: query index for each size of a -k list */
+	int stream;            /* RKBATCH: stream documents instead of loading them */
+	ac_automaton ac;       /* AHOCORASICK: automaton of the chunks of qs */
+	winnow_index wi;       /* WINNOW: fingerprints of qs */
+	minhash sketch;        /* SKETCH: sketch of qs */
+	int nthreads;          /* threads scanning one document */
+	int named;             /* prefix results with the document name */
+	int failed;            /* some document could not be read */
+	int stats;             /* -s: time the phases and count the scans */
+	rk_stats counters;     /* RKBATCH counters of all documents */
+	long long ns[NPHASES]; /* nanoseconds per phase, summed over documents */
+	long long target_bytes; /* normalized bytes of all documents */
+	int positions;         /* -P: POS_FIRST or POS_ALL, POS_NONE for counts only */
+};
+
+static long long
+now_ns(void)
 {
-	return ((a+b)>BIG_PRIME?(a+b-BIG_PRIME):(a+b));
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-
-/* modulo substraction */
-long long
-mdel(long long a, long long b)
+/* Charge the time since *t to phase p and restart *t. Documents are
+	 matched by several threads, hence the atomic add. */
+static void
+phase_end(struct match_ctx *ctx, enum phase p, long long *t)
 {
-	return ((a>b)?(a-b):(a+BIG_PRIME-b));
-}
+	long long now = now_ns();
 
-/* modulo multiplication*/
-long long
-mmul(long long a, long long b)
-{
-	return ((a*b) % BIG_PRIME);
+	__atomic_fetch_add(&ctx->ns[p], now - *t, __ATOMIC_RELAXED);
+	*t = now;
 }
 
-/* read the entire content of the file 'fname' into a 
-	 character array allocated by this procedure.
-	 Upon return, *doc contains the address of the character array
-	 *doc_len contains the length of the array
-	 */
-void
-read_file(const char *fname, char **doc, int *doc_len) 
+/* Write the statistics of -s as one JSON object to the standard error.
+	 The false positive rate is that of the bloom filter: the share of the
+	 probed positions not in the query that passed it. */
+static void
+print_stats(const struct match_ctx *ctx, int ndocs)
 {
-	struct stat st;
-	int fd;
-	int n = 0;
+	const rk_stats *c = &ctx->counters;
 
-	fd = open(fname, O_RDONLY);
-	if (fd < 0) {
-		perror("read_file: open ");
-		exit(1);
-	}
-
-	if (fstat(fd, &st) != 0) {
-		perror("read_file: fstat ");
-		exit(1);
-	}
-
-	*doc = (char *)malloc(st.st_size);
-	if (!(*doc)) {
-		fprintf(stderr, " failed to allocate %d bytes. No memory\n", (int)st.st_size);
-		exit(1);
+	fprintf(stderr, "{\"algo\": %d, \"k\": %d, \"documents\": %d, \"query_bytes\": %lld, "
+	        "\"target_bytes\": %lld,\n \"time_ms\": {", ctx->algo, ctx->k, ndocs, ctx->m, ctx->target_bytes);
+	for (int p = 0; p < NPHASES; p++) {
+		fprintf(stderr, "%s\"%s\": %.3f", p ? ", " : "", phase_names[p], ctx->ns[p] / 1e6);
 	}
-
-	n = read(fd, *doc, st.st_size);
-	if (n < 0) {
-		perror("read_file: read ");
-		exit(1);
-	}else if (n != st.st_size) {
-		fprintf(stderr,"read_file: short read!\n");
-		exit(1);
+	fprintf(stderr, "}");
+	if (ctx->algo == RKBATCH) {
+		const bloom_filter *f = &ctx->query.filter;
+
+		if (f->buf) {
+			fprintf(stderr, ",\n \"bloom\": {\"bits\": %lld, \"hashes\": %d, \"fill_ratio\": %.4f}",
+			        f->bsz, f->nhash, bloom_fill(*f));
+		} else {
+			fprintf(stderr, ",\n \"bloom\": null");
+		}
+		fprintf(stderr, ",\n \"probes\": %lld, \"bloom_hits\": %lld, \"matches\": %lld, "
+		        "\"false_positives\": %lld, \"false_positive_rate\": ", c->probes, c->hits,
+		        c->matches, c->hits - c->matches);
+		if (c->probes > c->matches) {
+			fprintf(stderr, "%.6f", (double)(c->hits - c->matches) / (c->probes - c->matches));
+		} else {
+			fprintf(stderr, "null");
+		}
+		fprintf(stderr, ", \"verify_bytes\": %lld", c->verify_bytes);
 	}
-	
-	close(fd);
-	*doc_len = n;
+	fprintf(stderr, "}\n");
 }
 
-
-/* The normalize procedure examines a character array of size len 
-	 in ONE PASS and does the following:
-	 1) turn all upper case letters into lower case ones
-	 2) turn any white-space character into a space character and, 
-	    shrink any n>1 consecutive spaces into exactly 1 space only
-			Hint: use C library function isspace() 
-	 You must do the normalization IN PLACE so that when the procedure
-	 returns, the character array buf contains the normalized string and 
-	 the return value is the length of the normalized string.
-*/
-int
-normalize(char *buf,	/* The character array containing the string to be normalized*/
-					int len			/* the size of the original character array */)
+/* With POS_FIRST, drop the matches of chunks matched before */
+static void
+keep_first(struct doc_hits *d)
 {
-	for (int i = 0; i < len; i++){ //convert all uppercase to lowercase
-		if (buf[i] >= 62 && buf[i] <= 90){
-			buf[i] += 32;
-		}
+	long long n = 0;
 
+	for (long long i = 0; i < d->hits.n; i++) {
+		long long c = d->hits.v[i].qoff / d->k;
 
-		if (isspace(buf[i])){ //convert different white space characters to t he space character
-			buf[i] = ' ';
-		}
+		if (d->seen && d->seen[c]) continue;
+		if (d->seen) d->seen[c] = 1;
+		d->hits.v[n++] = d->hits.v[i];
 	}
+	d->hits.n = n;
+}
 
-	for (int i = 0; i < len; i++){ //shrink multiple spaces to one
-		int count = 0;
-		if (isspace(buf[i])){
-			if (i < len -1){
-				int k = i + 1;
-				while (isspace(buf[k]) && k < len){
-					count++;
-					k++;
-				}
-				for (int j = i+1; j < len; j++){
-					buf[j] = buf[j+count];
-				}
-			}
+/* decimal digits of v >= 0 at p, return their number */
+static int
+put_ll(char *p, long long v)
+{
+	char tmp[20];
+	int n = 0, len;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	for (len = n; n > 0; n--) *p++ = tmp[n-1];
+	return len;
+}
 
+/* Write the matches of d, prefixed by prefix (shorter than 4 KB) unless it is NULL, and empty
+	 the list. The lines are formatted into a large buffer handed to stdio
+	 a block at a time. */
+static void
+write_hits(struct doc_hits *d, const char *prefix)
+{
+	static char buf[1 << 16];
+	size_t len = 0, plen = prefix ? strlen(prefix) : 0;
 
+	for (long long i = 0; i < d->hits.n; i++) {
+		if (len + plen + 48 > sizeof(buf)) {
+			fwrite(buf, 1, len, stdout);
+			len = 0;
 		}
-		len = len - count;
+		memcpy(buf + len, prefix, plen);
+		len += plen;
+		len += put_ll(buf + len, d->hits.v[i].qoff);
+		buf[len++] = ' ';
+		len += put_ll(buf + len, d->hits.v[i].toff);
+		buf[len++] = '\n';
 	}
+	fwrite(buf, 1, len, stdout);
+	d->hits.n = 0;
+}
 
+/* hits->flush of a streamed document: written while it is scanned */
+static void
+flush_hits(rk_hits *h, void *arg)
+{
+	keep_first(arg);
+	write_hits(arg, NULL);
+}
 
-	for (int i = 0; i < len; i++){ //remove white space at the beginning and end of text
-		if (i == 0 && isspace(buf[i])){
-			for (int j = i; j < len; j++){
-				buf[j] = buf[j+1];
-			}
-			len--;
-		}
+static struct doc_hits *
+doc_hits_new(const struct match_ctx *ctx, const char *fname)
+{
+	struct doc_hits *d = calloc(1, sizeof(*d));
 
-		else if ((i==len-1 || i == len -2) && isspace(buf[i])){
-			for (int j = i; j < len; j++){
-				buf[j] = buf[j+1];
-			}
-			len--;
-		}
+	if (!d || (ctx->positions == POS_FIRST && !(d->seen = calloc(ctx->m / ctx->k + 1, 1)))) {
+		fprintf(stderr, " failed to allocate the matches of %s. No memory\n", fname);
+		exit(1);
 	}
-	return len;
+	d->k = ctx->k;
+	rk_hits_init(&d->hits);
+	return d;
 }
 
-/* check if a query string ps (of length k) appears 
-	 in ts (of length n) as a substring 
-	 If so, return 1. Else return 0
-	 You may want to use the library function strncmp
-	 */
-int
-simple_match(const char *ps,	/* the query string */
-						 int k, 					/* the length of the query string */
-						 const char *ts,	/* the document string (Y) */ 
-						 int n						/* the length of the document Y */)
+static void
+doc_hits_free(struct doc_hits *d)
 {
-	if (k > n) {
-		return 0;
-	}
-
-	else {
-		int count;
-		for (int i = 0; (i+k) <= n; i++){
-			count = 0;
-			for (int j = 0; j < k; j++){
-				if (ps[j] == ts[j+i]){ //checking if individual characters match
-					count++;
-				}
-
-				else{
-					break;
-				}
-			}
-
-			if (count>=k) return 1; 
-		}
-	}
-	return 0;
+	rk_hits_free(&d->hits);
+	free(d->seen);
+	free(d);
 }
 
-void hash(const char *ps,	/* the query string */
-								 int k, 					/* the length of the query string */
-								 const char *ts,	/* the document string (Y) */ 
-								 long long int *largest,
-								 long long int *hashps, long long int *hashts){
-	// long long int asc = 256;
-	// long long int hashps = 0, pow;
-	long long int pow;
-	for (int i = 0; i < k; i++){
-			pow = 1;
-			for (int j = 1; j < k-i; j++){
-				pow = mmul(pow, asc);
-			}
+/* Allocate size bytes of the results of the document fname */
+static void *
+doc_alloc(const char *fname, size_t size)
+{
+	void *p = calloc(1, size);
 
-			if (i==0) *largest = pow;
-			*hashps = madd(*hashps, mmul(pow, ps[i]));
-			*hashts = madd(*hashts, mmul(pow, ts[i]));
+	if (!p) {
+		fprintf(stderr, " failed to allocate the results of %s. No memory\n", fname);
+		exit(1);
 	}
-
-	// return hashps;
+	return p;
 }
 
-/* Check if a query string ps (of length k) appears 
-	 in ts (of length n) as a substring using the rabin-karp algorithm
-	 If so, return 1. Else return 0
-	 In addition, print the first 'PRINT_RK_HASH' hash values of ts
-	 Example:
-	 $ ./rkmatch -t 1 -k 20 X Y
-	 605818861882592 812687061542252 1113263531943837 1168659952685767 4992125708617222 
-	 0.01 matched: 1 out of 148
-	 */
-
-int
-rabin_karp_match(const char *ps,	/* the query string */
-								 int k, 					/* the length of the query string */
-								 const char *ts,	/* the document string (Y) */ 
-								 int n						/* the length of the document Y */ )
+/* Match the query against the document fname with the selected algorithm.
+	 Return the number of matches, or -1 if the document cannot be read.
+	 *data is set to the match positions (struct doc_hits) with -P, the
+	 counts of each size of a -k list or the sketch (minhash) of -t 5. */
+static long long
+match_doc(const char *fname, void **data, void *arg)
 {
-	if (k > n) return 0;
-
-	else {
-		int printed = 0;
-		long long int hashps = 0, hashts = 0;
-		long long int pow, largest = 0;
-		for (int i = 0; i < k; i++){
-			pow = 1;
-			for (int j = 1; j < k-i; j++){
-				pow = mmul(pow, asc); 	//computing the power of the ith character
+	struct match_ctx *ctx = arg;
+	const char *qs = ctx->qs;
+	long long m = ctx->m;
+	int k = ctx->k;
+	long long num_matched = 0;
+	long long t = ctx->stats ? now_ns() : 0;
+	struct doc_hits *d = NULL;
+	document doc;
+
+	/* fname is the doc argument ("-" is the standard input) */
+	if (ctx->algo == RKBATCH && ctx->stream) {
+		/* reading and normalizing are part of the scan */
+		int fd = strcmp(fname, "-") == 0 ? STDIN_FILENO : open(fname, O_RDONLY);
+		if (fd < 0) {
+			perror("open ");
+			return -1;
+		}
+		if (ctx->positions) {
+			d = doc_hits_new(ctx, fname);
+			/* a single document is written as it is scanned, others wait
+			   for their turn in corpus order */
+			if (!ctx->named) {
+				d->hits.flush = flush_hits;
+				d->hits.arg = d;
 			}
-
-			if (i==0) largest = pow;	//saving the power of the first element to enhance rolling hashing
-			hashps = madd(hashps, mmul(pow, ps[i]));	//hash of query text
-			hashts = madd(hashts, mmul(pow, ts[i]));	//hash of substring of document to be compared with
 		}
+		num_matched = rk_scan_stream(&ctx->query, fd, ctx->nthreads, d ? &d->hits : NULL);
+		if (fd != STDIN_FILENO) close(fd);
+		if (ctx->stats) phase_end(ctx, DOC_SCAN, &t);
+		goto done;
+	}
 
-		// hash(ps, k, ts, &largest, &hashps, &hashts);
-
-		
-		for (int i = 0; (i+k) <= n; i++){
-			if (i > 0){	//rolling hashing
-				hashts = mdel(hashts, mmul(largest, ts[i-1]));
-				hashts = mmul(hashts, asc);
-				hashts = madd(hashts, ts[i+k-1]);
-			}
+	if (doc_read(fname, &doc) != 0) return -1;
+	if (ctx->stats) phase_end(ctx, DOC_READ, &t);
+	doc_normalize(&doc);
+	if (ctx->stats) {
+		phase_end(ctx, DOC_NORMALIZE, &t);
+		__atomic_fetch_add(&ctx->target_bytes, doc.len, __ATOMIC_RELAXED);
+	}
 
-			if(i<PRINT_RK_HASH){	//printing the first PRINT_RK_HASH hash values
-      			printf("%lld ", hashts);
-			}
-		    else if(i==PRINT_RK_HASH){
-		    	printed = 1;
-		      	printf("\n");
-		      
-		    }
-
-			if (hashts == hashps){	//checking if actual strings with same hash values match
-				int count = 0;
-				for (int j = 0; j < k; j++){
-					if (ps[j] == ts[j+i]){
-						count++;
+	switch (ctx->algo)
+		{
+			case SIMPLE:
+				/* for each of the qdoc_len/k chunks of qdoc, 
+					 check if it appears in doc as a substring*/
+				for (long long i = 0; (i+k) <= m; i += k) {
+					if (simple_match(qs+i, k, doc.buf, doc.len)) {
+						num_matched++;
 					}
-
-					else{
-						break;
-					}	
 				}
+				break;
+			case RK:
+				/* for each of the qdoc_len/k chunks of qdoc, 
+					 check if it appears in doc as a substring using 
+				   the rabin-karp substring matching algorithm */
+				for (long long i = 0; (i+k) <= m; i += k) {
+					if (rabin_karp_match(qs+i, k, doc.buf, doc.len)) {
+						num_matched++;
+					}
+				}
+				break;
+			case RKBATCH:
+				if (ctx->nk > 1) {
+					/* one pass over doc for all the sizes */
+					long long *counts = doc_alloc(fname, ctx->nk * sizeof(long long));
 
-				if (count >= k) {
-					if (!printed) printf("\n");
-					return 1;
-					
+					rk_scan_ks(ctx->kq, ctx->nk, doc.buf, doc.len, ctx->nthreads, counts);
+					*data = counts;
+					break;
 				}
-			}
+				/* match all qdoc_len/k chunks simultaneously (in batch) by using a bloom filter*/
+				if (ctx->positions) d = doc_hits_new(ctx, fname);
+				num_matched = rk_scan_parallel(&ctx->query, doc.buf, doc.len, ctx->nthreads,
+				                               d ? &d->hits : NULL);
+				break;
+			case AHOCORASICK:
+				/* find all qdoc_len/k chunks in one pass over doc */
+				num_matched = ac_match(&ctx->ac, doc.buf, doc.len);
+				break;
+			case WINNOW:
+				/* fingerprints of doc that are fingerprints of qdoc */
+				num_matched = winnow_match(&ctx->wi, doc.buf, doc.len);
+				break;
+			case SKETCH:
+				/* compared with the query's when reported */
+				*data = doc_alloc(fname, sizeof(minhash));
+				minhash_build(*data, doc.buf, doc.len, k, ctx->sketch.size);
+				break;
+		}
+	if (ctx->stats) phase_end(ctx, DOC_SCAN, &t);
+
+	doc_free(&doc);
+done:
+	if (d) {
+		if (num_matched < 0) {
+			doc_hits_free(d);
+		} else {
+			keep_first(d);
+			*data = d;
 		}
-	
 	}
-	return 0;
+	return num_matched;
 }
 
-/* Initialize the bitmap for the bloom filter using bloom_init().
-	 Insert all m/k RK hashes of qs into the bloom filter using bloom_add().
-	 Then, compute each of the n-k+1 RK hashes of ts and check if it's in the filter using bloom_query().
-	 Use the given procedure, hash_i(i, p), to compute the i-th bloom filter hash value for the RK value p.
-
-	 Return the number of matched chunks. 
-	 Additionally, print out the first PRINT_BLOOM_BITS of the bloom filter using the given bloom_print 
-	 after inserting m/k substrings from qs.
-*/
-
+static int
+cmp_ll(const void *x, const void *y)
+{
+	long long a = *(const long long *)x, b = *(const long long *)y;
+	return a < b ? -1 : a > b;
+}
 
-long long calculate(const char *ps, int k) {
+/* Look the fingerprints of qs up in the index x and print, in index order,
+	 the result line of every document containing some: the number of
+	 distinct query fingerprints found in it out of all of them. Only the
+	 query is hashed; the work depends on its fingerprints and their
+	 postings, not on the size of the corpus. Fingerprints are compared by
+	 hash only, the index does not hold the documents.
+	 With topk > 0, only the lines of the topk documents with the most
+	 fingerprints found are printed, best first (see kindex_top()). */
+static void
+match_index(const kindex *x, const char *qs, long long m, int topk)
+{
+	long long *hashes, nq = kindex_query_hashes(x, qs, m, &hashes);
+	long long *docs = NULL, ndocs = 0, cap = 0;
+
+	if (topk > 0) {
+		kindex_hit *hits;
+		long long nhits;
+
+		if (topk > x->ndocs) topk = x->ndocs > 0 ? x->ndocs : 1;
+		hits = malloc(topk * sizeof(kindex_hit));
+		nhits = hits ? kindex_top(x, hashes, nq, topk, hits) : -1;
+		if (nhits < 0) {
+			fprintf(stderr, " failed to allocate the top %d documents. No memory\n", topk);
+			exit(1);
+		}
+		for (long long i = 0; i < nhits; i++) {
+			printf("%s: %.2f matched: %lld out of %lld\n", kindex_doc_name(x, hits[i].doc),
+			       (double)hits[i].matched/nq, hits[i].matched, nq);
+		}
+		free(hits);
+		free(hashes);
+		return;
+	}
 
-	long long int pow, hashps = 0;
-	for (int i = 0; i < k; i++){
-			pow = 1;
-			for (int j = 1; j < k-i; j++){
-				pow = mmul(pow, asc);
+	for (long long i = 0; i < nq; i++) {
+		kindex_iter it;
+		long long last = -1;
+
+		if (!kindex_lookup(x, hashes[i], &it)) continue;
+		/* one entry per document holding the fingerprint */
+		while (kindex_next(&it)) {
+			if (it.doc == last || it.doc < 0 || it.doc >= x->ndocs) continue;
+			if (ndocs == cap) {
+				cap = cap ? 2 * cap : 1024;
+				docs = realloc(docs, cap * sizeof(long long));
+				if (!docs) {
+					fprintf(stderr, " failed to allocate %lld postings. No memory\n", cap);
+					exit(1);
+				}
 			}
-			hashps = madd(hashps, mmul(pow, ps[i]));
+			docs[ndocs++] = last = it.doc;
+		}
 	}
-	return hashps;
 
+	qsort(docs, ndocs, sizeof(long long), cmp_ll);
+	for (long long i = 0, j; i < ndocs; i = j) {
+		for (j = i; j < ndocs && docs[j] == docs[i]; j++);
+		printf("%s: %.2f matched: %lld out of %lld\n", kindex_doc_name(x, docs[i]),
+		       (double)(j - i)/nq, j - i, nq);
+	}
+	free(docs);
+	free(hashes);
 }
 
-int
-rabin_karp_batchmatch(int bsz,        /* size of bitmap (in bits) to be used */
-                      int k,          /* chunk length to be matched */
-                      const char *qs, /* query docoument (X)*/
-                      int m,          /* query document length */ 
-                      const char *ts, /* to-be-matched document (Y) */
-                      int n           /* to-be-matched document length*/)
+/* The pre-filter of the m/k chunks of a -t 2 query. The classic sizing
+	 (10 bits and hashes per chunk, placed by hash_i()) is kept for small
+	 queries. A target false positive rate, huge pages or a filter too large
+	 for hash_i() select a filter sized for the number of chunks, with
+	 64-bit double hashing. */
+static bloom_filter
+query_filter(long long m, int k, int use_bloom, double fpr, int bloom_type, int bloom_flags)
 {
-	bloom_filter char_array = bloom_init(bsz);	//initializing bloom filter
+	long long bsz = ((m*10/k)>>3)<<3;
 
+	if (use_bloom && (fpr > 0 || bloom_flags || bsz > RK_CLASSIC_MAX_BITS)) {
+		return bloom_init_fpr(m / k, fpr > 0 ? fpr : RK_DEFAULT_FPR, bloom_type, bloom_flags);
+	} else if (use_bloom && bsz > 0) {
+		return bloom_init_type(bsz, bloom_type);
+	}
+	return (bloom_filter){ 0 };
+}
 
-	long long int hashqs = 0, hashts = 0;
-	long long int pow = 1, largest = 0;
-	int count = 0;
-	for (int i = 0; i < m; i+=k){	//computing hash values
-		hashqs = calculate(qs+i, k);
-		bloom_add(char_array, hashqs);	//adding element to bloom filter
+/* Match every query of queries against the document target in a single
+	 scan of it (see rk_scan_multi()) and print their result lines, in the
+	 order of the list. Return 1 if a document could not be read. */
+static int
+match_queries(const corpus *queries, const char *target, int k, int nthreads,
+              int use_bloom, double fpr, int bloom_type, int bloom_flags)
+{
+	document *q = malloc(queries->n * sizeof(document));
+	const char **qs = malloc(queries->n * sizeof(char *));
+	long long *m = malloc(queries->n * sizeof(long long));
+	long long *counts = malloc(queries->n * sizeof(long long));
+	const char **names = malloc(queries->n * sizeof(char *));
+	long long total = 0;
+	int nq = 0, failed = 0;
+	document doc;
+	rk_multi mq;
+
+	if (!q || !qs || !m || !counts || !names) {
+		fprintf(stderr, " failed to allocate %d queries. No memory\n", queries->n);
+		exit(1);
+	}
+	for (int i = 0; i < queries->n; i++) {
+		if (doc_read(queries->names[i], &q[nq]) != 0) {
+			fprintf(stderr, "%s: skipped\n", queries->names[i]);
+			failed = 1;
+			continue;
+		}
+		doc_normalize(&q[nq]);
+		names[nq] = queries->names[i];
+		qs[nq] = q[nq].buf;
+		m[nq] = q[nq].len;
+		total += m[nq] / k * k;
+		nq++;
 	}
+	if (doc_read(target, &doc) != 0) exit(1);
+	doc_normalize(&doc);
 
-	bloom_print(char_array, PRINT_BLOOM_BITS);	//printing bits
+	mq = rk_build_multi(query_filter(total, k, use_bloom, fpr, bloom_type, bloom_flags), k, qs, m, nq);
+	for (int i = 0; i < nq; i++) doc_free(&q[i]);
+	bloom_print(mq.q.filter, PRINT_BLOOM_BITS);	//printing bits
 
-	for (int j = 1; j < k; j++){
-			pow = mmul(pow, asc);
-		}
-	for (int i = 0; (i+k) <= n; i++){
-		if (i==0){
-			hashts = calculate(ts, k);
-		}
+	rk_scan_multi(&mq, doc.buf, doc.len, nthreads, counts);
+	for (int i = 0; i < nq; i++) {
+		long long to_be_matched = m[i] / k;
 
+		printf("%s: %.2f matched: %lld out of %lld\n", names[i], (double)counts[i]/to_be_matched,
+		       counts[i], to_be_matched);
+	}
 
-		
+	rk_free_multi(&mq);
+	doc_free(&doc);
+	free(q);
+	free(qs);
+	free(m);
+	free(counts);
+	free(names);
+	return failed;
+}
 
-		
+static void
+report_doc(const char *fname, long long num_matched, void *data, void *arg)
+{
+	struct match_ctx *ctx = arg;
+	long long to_be_matched = ctx->algo == WINNOW ? ctx->wi.fps.n : ctx->m / ctx->k;
 
-		if(i > 0){	//rolling hashing
-			hashts = mdel(hashts, mmul(pow, ts[i-1]));
-			hashts = mmul(hashts, asc);
-			hashts = madd(hashts, ts[i+k-1]);
-		}
+	if (num_matched < 0) {
+		fprintf(stderr, "%s: skipped\n", fname);
+		ctx->failed = 1;
+		return;
+	}
+	if (ctx->nk > 1) {
+		long long *counts = data;
 
-		if (bloom_query(char_array, hashts)){
-			for(int j=0; j<m; j+=k){
-				
+		for (int i = 0; i < ctx->nk; i++) {
+			long long m = counts[i], n = ctx->m / ctx->kq[i].k;
 
-				if(!strncmp(&qs[j], &ts[i], k)){
-				  count++;
-				  break;
-				}
-			
-			
-			}
+			if (ctx->named) printf("%s: ", fname);
+			printf("k=%d: %.2f matched: %lld out of %lld\n", ctx->kq[i].k, (double)m/n, m, n);
 		}
+		free(counts);
+		return;
 	}
-		
-
-	return count;
+	if (ctx->algo == SKETCH) {
+		minhash *sketch = data;
+		int samples;
+		double c = minhash_containment(&ctx->sketch, sketch, &samples);
+
+		if (ctx->named) printf("%s: ", fname);
+		printf("%.2f estimated (jaccard %.2f, %d samples)\n", c,
+		       minhash_jaccard(&ctx->sketch, sketch), samples);
+		minhash_free(sketch);
+		free(sketch);
+		return;
+	}
+	if (data) {
+		char prefix[4096];
 
+		snprintf(prefix, sizeof(prefix), "%s: ", fname);
+		write_hits(data, ctx->named ? prefix : NULL);
+		doc_hits_free(data);
+	}
+	if (ctx->named) printf("%s: ", fname);
+	printf("%.2f matched: %lld out of %lld\n", (double)num_matched/to_be_matched, 
+			num_matched, to_be_matched);
 }
 
-
-
-
-
 int 
 main(int argc, char **argv)
 {
 	int k = 100; /* default match size is 100*/
 	int which_algo = SIMPLE; /* default match algorithm is simple */
 
-	char *qdoc, *doc; 
-	int qdoc_len, doc_len;
-	int i;
-	int num_matched = 0;
-	int to_be_matched;
+	document qdoc;
+	corpus docs;
+	corpus queries; /* query documents matched at once (-Q) */
+	struct match_ctx ctx;
+	rk_query saved; /* query loaded from a filter file */
+	int stream = 0; /* stream the to-be-matched documents (-t 2 only) */
+	int nthreads = 1; /* threads scanning the documents */
+	int use_bloom = 1; /* bloom pre-filter in front of the exact index (-t 2 only) */
+	int bloom_type = BLOOM_STANDARD; /* bit layout of the pre-filter */
+	double fpr = 0; /* target false positive rate of the pre-filter, 0 for 10 bits per chunk */
+	int bloom_flags = 0; /* BLOOM_HUGEPAGES */
+	const char *save_file = NULL; /* save the query into this filter file (-o) */
+	const char *load_file = NULL; /* take the query from this filter file (-f) */
+	const char *index_file = NULL; /* match the query against this index (-I) */
+	int topk = 0; /* only print the topk best documents of the index (-T) */
+	int k_set = 0, q_set = 0; /* -k / -q given */
+	int t_set = 0, j_set = 0, b_set = 0, n_set = 0; /* -t / -j / -b / -n given */
+	int stats = 0; /* print statistics (-s) */
+	int positions = POS_NONE; /* write match positions (-P) */
+	int window = 0; /* winnowing window (-w), 0 for k */
+	int ks[RK_MAX_KS], nk = 1; /* sizes of a -k list */
+	int sketch_size = RK_DEFAULT_SKETCH; /* values of a sketch (-n) */
+	long long qns[3] = { 0 }; /* time of the query phases */
+	long long t = 0;
 	int c;
 
 	/* Refuse to run on platform with a different size for long long*/
 	assert(sizeof(long long) == 8);
 
+	corpus_init(&docs);
+	corpus_init(&queries);
+
 	/*getopt is a C library function to parse command line options */
-	while (( c = getopt(argc, argv, "t:k:q:")) != -1) {
+	while (( c = getopt(argc, argv, "t:k:q:Sj:l:Bb:p:Ho:f:sP:w:I:T:Q:n:")) != -1) {
 		switch (c) 
 		{
 			case 't':
 				/*optarg is a global variable set by getopt() 
 					it now points to the text following the '-t' */
 				which_algo = atoi(optarg);
+				t_set = 1;
 				break;
 			case 'k':
 				k = atoi(optarg);
+				k_set = 1;
+				nk = 1;
+				if (strchr(optarg, ',')) {
+					char *p = optarg;
+
+					for (nk = 0; nk < RK_MAX_KS; p++) {
+						ks[nk++] = strtol(p, &p, 10);
+						if (ks[nk-1] < 1 || *p != ',') break;
+					}
+					if (*p || ks[nk-1] < 1) {
+						fprintf(stderr, "Match sizes must be a list of at most %d sizes of 1 or more\n", RK_MAX_KS);
+						exit(1);
+					}
+					k = ks[0];
+				}
 				break;
 			case 'q':
-				BIG_PRIME = atoi(optarg);
+				if (rk_set_modulus(atoll(optarg)) != 0) {
+					fprintf(stderr, "Prime modulus must be at least 257 and below 2^62\n");
+					exit(1);
+				}
+				q_set = 1;
+				break;
+			case 'S':
+				stream = 1;
+				break;
+			case 'j':
+				nthreads = atoi(optarg);
+				if (nthreads < 1) nthreads = 1;
+				j_set = 1;
+				break;
+			case 'l':
+				if (corpus_add_list(&docs, optarg) != 0) exit(1);
+				break;
+			case 'B':
+				use_bloom = 0;
+				break;
+			case 'b':
+				if (strcmp(optarg, "blocked") == 0) {
+					bloom_type = BLOOM_BLOCKED;
+				} else if (strcmp(optarg, "standard") == 0) {
+					bloom_type = BLOOM_STANDARD;
+				} else {
+					fprintf(stderr, "Bloom filter layout must be standard or blocked\n");
+					exit(1);
+				}
+				b_set = 1;
+				break;
+			case 'p':
+				fpr = atof(optarg);
+				if (fpr <= 0 || fpr >= 1) {
+					fprintf(stderr, "False positive rate must be between 0 and 1\n");
+					exit(1);
+				}
+				break;
+			case 'H':
+				bloom_flags |= BLOOM_HUGEPAGES;
+				break;
+			case 'o':
+				save_file = optarg;
+				break;
+			case 'f':
+				load_file = optarg;
+				break;
+			case 's':
+				stats = 1;
+				break;
+			case 'I':
+				index_file = optarg;
+				break;
+			case 'T':
+				topk = atoi(optarg);
+				if (topk < 1) {
+					fprintf(stderr, "Top document count must be at least 1\n");
+					exit(1);
+				}
+				break;
+			case 'n':
+				sketch_size = atoi(optarg);
+				if (sketch_size < 1) {
+					fprintf(stderr, "Sketch size must be at least 1\n");
+					exit(1);
+				}
+				n_set = 1;
+				break;
+			case 'Q':
+				if (corpus_add_list(&queries, optarg) != 0) exit(1);
+				if (queries.n < 1) {
+					fprintf(stderr, "%s: no query documents\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'w':
+				window = atoi(optarg);
+				if (window < 1) {
+					fprintf(stderr, "Winnowing window must be at least 1\n");
+					exit(1);
+				}
+				break;
+			case 'P':
+				if (strcmp(optarg, "first") == 0) {
+					positions = POS_FIRST;
+				} else if (strcmp(optarg, "all") == 0) {
+					positions = POS_ALL;
+				} else {
+					fprintf(stderr, "Match positions must be first or all\n");
+					exit(1);
+				}
 				break;
 			default:
 				fprintf(stderr,
-						"Valid options are: -t <algo type> -k <match size> -q <prime modulus>\n");
+						"Valid options are: -t <algo type> -k <match size> -q <prime modulus> -S (stream doc) -j <threads> -l <doc list file> -B (no bloom pre-filter) -b <standard|blocked> -p <bloom false positive rate> -H (huge pages) -o <filter file to save> -f <filter file to match with> -s (statistics) -P <first|all> (match positions) -w <winnowing window> -I <index file> -T <top document count> -Q <query list file> -n <sketch size>\n");
 				exit(1);
 			}
 	}
@@ -421,55 +769,186 @@ main(int argc, char **argv)
 	/* optind is a global variable set by getopt() 
 		 it now contains the index of the first argv-element 
 		 that is not an option*/
-	if (argc - optind < 1) {
-		printf("Usage: ./rkmatch query_doc doc\n");
+	for (int i = load_file ? optind : optind + 1; i < argc; i++) {
+		if (corpus_add(&docs, argv[i]) != 0) exit(1);
+	}
+	if (save_file || index_file || queries.n
+	    ? argc - optind != 1 || load_file || !!save_file + !!index_file + !!queries.n > 1
+	    : argc - optind < 1 || docs.n < 1) {
+		printf("Usage: ./rkmatch query_doc doc1 [doc2...]\n");
 		exit(1);
 	}
 
-	/* argv[optind] contains the query_doc argument */
-	read_file(argv[optind], &qdoc, &qdoc_len); 
-	qdoc_len = normalize(qdoc, qdoc_len);
+	/* the index is matched one way, with one thread */
+	if (index_file && (t_set || stream || positions || stats || j_set || !use_bloom || b_set || fpr
+	                   || bloom_flags)) {
+		fprintf(stderr, "Index matching (-I) takes none of -t -S -P -s -j -B -b -p -H\n");
+		exit(1);
+	}
 
-	/* argv[optind+1] contains the doc argument */
-	read_file(argv[optind+1], &doc, &doc_len);
-	doc_len = normalize(doc, doc_len);
+	if (which_algo < SIMPLE || which_algo > SKETCH) {
+		fprintf(stderr,"Wrong algorithm type, choose from 0 1 2 3 4 5\n");
+		exit(1);
+	}
+	if (stream && which_algo != RKBATCH) {
+		fprintf(stderr, "Streaming (-S) is only supported with -t 2\n");
+		exit(1);
+	}
+	if (positions && which_algo != RKBATCH) {
+		fprintf(stderr, "Match positions (-P) are only reported with -t 2\n");
+		exit(1);
+	}
+	if ((save_file || load_file) && (which_algo != RKBATCH || !use_bloom)) {
+		fprintf(stderr, "Filter files (-o, -f) need -t 2 with a bloom filter\n");
+		exit(1);
+	}
 
-	switch (which_algo) 
-		{
-			case SIMPLE:
-				/* for each of the qdoc_len/k chunks of qdoc, 
-					 check if it appears in doc as a substring*/
-				for (i = 0; (i+k) <= qdoc_len; i += k) {
-					if (simple_match(qdoc+i, k, doc, doc_len)) {
-						num_matched++;
-					}
-				}
-				break;
-			case RK:
-				/* for each of the qdoc_len/k chunks of qdoc, 
-					 check if it appears in doc as a substring using 
-				   the rabin-karp substring matching algorithm */
-				for (i = 0; (i+k) <= qdoc_len; i += k) {
-					if (rabin_karp_match(qdoc+i, k, doc, doc_len)) {
-						num_matched++;
-					}
-				}
-				break;
-			case RKBATCH:
-				/* match all qdoc_len/k chunks simultaneously (in batch) by using a bloom filter*/
-				num_matched = rabin_karp_batchmatch(((qdoc_len*10/k)>>3)<<3, k, qdoc, qdoc_len, doc, doc_len);
-				break;
-			default :
-				fprintf(stderr,"Wrong algorithm type, choose from 0 1 2\n");
-				exit(1);
+	if (nk > 1 && (which_algo != RKBATCH || stream || positions || stats || save_file || load_file
+	               || queries.n || index_file)) {
+		fprintf(stderr, "A list of match sizes (-k) needs -t 2, without -S -P -s -o -f -Q -I\n");
+		exit(1);
+	}
+
+	if (window && which_algo != WINNOW && !index_file) {
+		fprintf(stderr, "Winnowing windows (-w) are only used with -t 4 or -I\n");
+		exit(1);
+	}
+
+	if (n_set && which_algo != SKETCH) {
+		fprintf(stderr, "Sketch sizes (-n) are only used with -t 5\n");
+		exit(1);
+	}
+
+	if (topk && !index_file) {
+		fprintf(stderr, "Top documents (-T) are only ranked with -I\n");
+		exit(1);
+	}
+
+	if (queries.n) {
+		int ret;
+
+		if (which_algo != RKBATCH || stream || positions || stats) {
+			fprintf(stderr, "Query lists (-Q) need -t 2, without -S -P -s\n");
+			exit(1);
 		}
-	
-	to_be_matched = qdoc_len / k;
-	printf("%.2f matched: %d out of %d\n", (double)num_matched/to_be_matched, 
-			num_matched, to_be_matched);
+		ret = match_queries(&queries, argv[optind], k, nthreads, use_bloom, fpr, bloom_type, bloom_flags);
+		corpus_free(&queries);
+		corpus_free(&docs);
+		return ret;
+	}
+
+	if (index_file) {
+		/* the index fixes k, the window and the modulus */
+		kindex x;
+
+		if (kindex_load(index_file, &x) != 0) exit(1);
+		if ((k_set && x.k != k) || (window && x.w != window) || (q_set && x.modulus != BIG_PRIME)) {
+			fprintf(stderr, "%s was built with -k %d -w %d -q %lld\n", index_file, x.k, x.w, x.modulus);
+			exit(1);
+		}
+		if (rk_set_modulus(x.modulus) != 0) {
+			fprintf(stderr, "%s: invalid modulus %lld\n", index_file, x.modulus);
+			exit(1);
+		}
+		if (doc_read(argv[optind], &qdoc) != 0) exit(1);
+		doc_normalize(&qdoc);
+		match_index(&x, qdoc.buf, qdoc.len, topk);
+		kindex_free(&x);
+		doc_free(&qdoc);
+		corpus_free(&docs);
+		return 0;
+	}
+
+	if (load_file) {
+		/* the saved query replaces query_doc; its k and modulus must be used */
+		int fk = k;
+		long long q = BIG_PRIME, fq;
+
+		t = now_ns();
+		if (rk_load_query(load_file, &saved, &fk, &fq) != 0) exit(1);
+		qns[QUERY_READ] = now_ns() - t;
+		if ((k_set && fk != k) || (q_set && fq != q)) {
+			fprintf(stderr, "%s was built with -k %d -q %lld\n", load_file, fk, fq);
+			exit(1);
+		}
+		k = fk;
+		qdoc = (document){ 0 };
+	} else {
+		/* argv[optind] contains the query_doc argument */
+		t = now_ns();
+		if (doc_read(argv[optind], &qdoc) != 0) exit(1);
+		qns[QUERY_READ] = now_ns() - t;
+		doc_normalize(&qdoc);
+		qns[QUERY_NORMALIZE] = now_ns() - t - qns[QUERY_READ];
+	}
+
+	ctx = (struct match_ctx){ which_algo, k, qdoc.buf, qdoc.len };
+	ctx.stream = stream;
+	ctx.named = docs.n > 1;
+	ctx.stats = stats;
+	ctx.positions = positions;
+	ctx.nk = nk;
+
+	if (nk > 1) {
+		/* an index per size, each filled from the same query */
+		for (int i = 0; i < nk; i++) {
+			ctx.kq[i] = rk_build_query(query_filter(qdoc.len, ks[i], use_bloom, fpr, bloom_type, bloom_flags),
+			                           ks[i], qdoc.buf, qdoc.len);
+			bloom_print(ctx.kq[i].filter, PRINT_BLOOM_BITS);	//printing bits
+		}
+	} else if (load_file) {
+		ctx.query = saved;
+		ctx.qs = saved.qs;
+		ctx.m = saved.m;
+		bloom_print(ctx.query.filter, PRINT_BLOOM_BITS);	//printing bits
+	} else if (which_algo == RKBATCH) {
+		/* the query's index is built once for all documents */
+		bloom_filter filter = query_filter(qdoc.len, k, use_bloom, fpr, bloom_type, bloom_flags);
+
+		t = now_ns();
+		ctx.query = rk_build_query(filter, k, qdoc.buf, qdoc.len);
+		qns[QUERY_HASHING] = now_ns() - t;
+		if (save_file) {
+			int ret = rk_save_query(&ctx.query, save_file);
+			rk_free_query(&ctx.query);
+			doc_free(&qdoc);
+			return ret != 0;
+		}
+		bloom_print(ctx.query.filter, PRINT_BLOOM_BITS);	//printing bits
+	} else if (which_algo == AHOCORASICK) {
+		t = now_ns();
+		ac_build(&ctx.ac, qdoc.buf, qdoc.len, k);
+		qns[QUERY_HASHING] = now_ns() - t;
+	} else if (which_algo == WINNOW) {
+		t = now_ns();
+		winnow_build(&ctx.wi, qdoc.buf, qdoc.len, k, window > 0 ? window : k);
+		qns[QUERY_HASHING] = now_ns() - t;
+	} else if (which_algo == SKETCH) {
+		t = now_ns();
+		minhash_build(&ctx.sketch, qdoc.buf, qdoc.len, k, sketch_size);
+		qns[QUERY_HASHING] = now_ns() - t;
+	}
+	for (int p = QUERY_READ; p <= QUERY_HASHING; p++) ctx.ns[p] = qns[p];
+	if (stats && which_algo == RKBATCH) ctx.query.stats = &ctx.counters;
+
+	/* A single document is scanned by all threads. Otherwise every thread
+		 takes whole documents; RK prints while matching, so it keeps to one. */
+	if (docs.n == 1) {
+		ctx.nthreads = nthreads;
+		corpus_run(&docs, 1, match_doc, report_doc, &ctx);
+	} else {
+		ctx.nthreads = 1;
+		corpus_run(&docs, which_algo == RK ? 1 : nthreads, match_doc, report_doc, &ctx);
+	}
 
-	free(qdoc);
-	free(doc);
+	if (stats) print_stats(&ctx, docs.n);
+	if (which_algo == RKBATCH && nk == 1) rk_free_query(&ctx.query);
+	for (int i = 0; nk > 1 && i < nk; i++) rk_free_query(&ctx.kq[i]);
+	if (which_algo == AHOCORASICK) ac_free(&ctx.ac);
+	if (which_algo == WINNOW) winnow_free(&ctx.wi);
+	if (which_algo == SKETCH) minhash_free(&ctx.sketch);
+	doc_free(&qdoc);
+	corpus_free(&docs);
 
-	return 0;
+	return ctx.failed;
 }
@@ -0,0 +1,340 @@
+/* Keep a collection of documents doc1, doc2, ... resident and match the
+	 queries of clients against them.
+
+	 ./rkserve [-j threads] [-l doc_list] -u socket_path doc1 [doc2...]
+
+	 The documents are read and normalized once, then the server listens on
+	 the UNIX socket socket_path. Each request carries a query (its text, or
+	 the path of a file the server reads), the algorithm of rkmatch -t, k
+	 and, for -t 4, the winnowing window; the reply holds the result line
+	 of rkmatch for every document, "doc: fraction matched: X out of Y"
+	 (see proto.h for the framing). The -j threads each serve one client
+	 connection at a time; more clients wait for a free thread.
+
+	 ./rkbench serve socket_path query_doc [clients] [requests] [algo] [k]
+
+	 measures the requests per second and latency of a running server.
+	 SIGINT and SIGTERM stop the server and remove socket_path.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "bloom.h"
+#include "normalize.h"
+#include "doc.h"
+#include "corpus.h"
+#include "rk.h"
+#include "ac.h"
+#include "winnow.h"
+#include "proto.h"
+
+enum algotype { SIMPLE = 0, RK, RKBATCH, AHOCORASICK, WINNOW};
+
+/* false positive rate of the query filters (-t 2) */
+#define RK_SERVE_FPR 0.01
+
+/* accepted connections waiting for a thread */
+#define SERVE_QUEUE 256
+
+struct server {
+	const char **names;     /* resident documents, normalized */
+	document *docs;
+	int ndocs;
+	pthread_mutex_t lock;   /* guards the queue */
+	pthread_cond_t nonempty, nonfull;
+	int queue[SERVE_QUEUE]; /* connections, from head on */
+	int head, len;
+};
+
+static volatile sig_atomic_t stopping;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+/* Match the query qs against every resident document with the algorithm
+	 of req and write the result lines to out. Return the number of lines,
+	 or -1 after writing the reason to out. */
+static int
+match_all(struct server *s, const proto_request *req, const char *qs, long long m, FILE *out)
+{
+	int k = req->k;
+	rk_query q;
+	ac_automaton ac;
+	winnow_index wi;
+	long long to_be_matched = m / k;
+
+	switch (req->algo)
+		{
+			case RKBATCH:
+				q = rk_build_query(m / k > 0 ? bloom_init_fpr(m / k, RK_SERVE_FPR, BLOOM_BLOCKED, 0)
+				                             : (bloom_filter){ 0 }, k, qs, m);
+				break;
+			case AHOCORASICK:
+				ac_build(&ac, qs, m, k);
+				break;
+			case WINNOW:
+				winnow_build(&wi, qs, m, k, req->window > 0 ? req->window : k);
+				to_be_matched = wi.fps.n;
+				break;
+		}
+
+	for (int d = 0; d < s->ndocs; d++) {
+		const char *ts = s->docs[d].buf;
+		long long n = s->docs[d].len, num_matched = 0;
+
+		switch (req->algo)
+			{
+				case SIMPLE:
+					for (long long i = 0; (i+k) <= m; i += k) {
+						if (simple_match(qs+i, k, ts, n)) num_matched++;
+					}
+					break;
+				case RK:
+					for (long long i = 0; (i+k) <= m; i += k) {
+						if (rabin_karp_match(qs+i, k, ts, n)) num_matched++;
+					}
+					break;
+				case RKBATCH:
+					num_matched = rk_scan(&q, ts, n);
+					break;
+				case AHOCORASICK:
+					num_matched = ac_match(&ac, ts, n);
+					break;
+				case WINNOW:
+					num_matched = winnow_match(&wi, ts, n);
+					break;
+			}
+		fprintf(out, "%s: %.2f matched: %lld out of %lld\n", s->names[d],
+		        (double)num_matched/to_be_matched, num_matched, to_be_matched);
+	}
+
+	if (req->algo == RKBATCH) rk_free_query(&q);
+	if (req->algo == AHOCORASICK) ac_free(&ac);
+	if (req->algo == WINNOW) winnow_free(&wi);
+	return s->ndocs;
+}
+
+/* Answer one request whose query is body. Return -1 if the reply cannot be
+	 sent. */
+static int
+serve_request(struct server *s, int fd, const proto_request *req, char *body, size_t blen)
+{
+	proto_reply rep = { PROTO_OK, 0 };
+	document qdoc = { 0 };
+	char *text = NULL;
+	size_t len = 0;
+	FILE *out = open_memstream(&text, &len);
+	int ret;
+
+	if (!out) {
+		perror("open_memstream ");
+		return -1;
+	}
+	if (req->algo < SIMPLE || req->algo > WINNOW) {
+		fprintf(out, "Wrong algorithm type, choose from 0 1 2 3 4\n");
+		rep.status = PROTO_ERROR;
+	} else if (req->k < 1) {
+		fprintf(out, "Match size must be at least 1\n");
+		rep.status = PROTO_ERROR;
+	} else if (req->flags & PROTO_QUERY_PATH) {
+		if (doc_read(body, &qdoc) != 0) {
+			fprintf(out, "%s: cannot read the query\n", body);
+			rep.status = PROTO_ERROR;
+		}
+	} else {
+		/* the text is normalized where it was received */
+		qdoc.buf = body;
+		qdoc.len = blen;
+	}
+
+	if (rep.status == PROTO_OK) {
+		qdoc.len = normalize(qdoc.buf, qdoc.len);
+		rep.ndocs = match_all(s, req, qdoc.buf, qdoc.len, out);
+	}
+	if (req->flags & PROTO_QUERY_PATH) doc_free(&qdoc);
+
+	fclose(out);
+	ret = proto_send(fd, &rep, sizeof(rep), text, len);
+	free(text);
+	return ret;
+}
+
+/* Serve the requests of the connection fd until the client closes it */
+static void
+serve_client(struct server *s, int fd)
+{
+	for (;;) {
+		proto_request req;
+		char *body;
+		size_t blen;
+		int ret = proto_recv(fd, &req, sizeof(req), &body, &blen);
+
+		if (ret != 0) {
+			if (ret < 0) fprintf(stderr, "rkserve: bad request, connection closed\n");
+			break;
+		}
+		ret = serve_request(s, fd, &req, body, blen);
+		free(body);
+		if (ret != 0) break;
+	}
+	close(fd);
+}
+
+static void *
+worker(void *arg)
+{
+	struct server *s = arg;
+
+	for (;;) {
+		int fd;
+
+		pthread_mutex_lock(&s->lock);
+		while (s->len == 0) pthread_cond_wait(&s->nonempty, &s->lock);
+		fd = s->queue[s->head];
+		s->head = (s->head + 1) % SERVE_QUEUE;
+		s->len--;
+		pthread_cond_signal(&s->nonfull);
+		pthread_mutex_unlock(&s->lock);
+
+		serve_client(s, fd);
+	}
+	return NULL;
+}
+
+/* Read and normalize the documents of c, skipping those that cannot be
+	 read. Return the number kept. */
+static int
+load_docs(struct server *s, const corpus *c)
+{
+	s->names = malloc(c->n * sizeof(*s->names));
+	s->docs = malloc(c->n * sizeof(*s->docs));
+	if (!s->names || !s->docs) {
+		fprintf(stderr, " failed to allocate %d documents. No memory\n", c->n);
+		exit(1);
+	}
+	s->ndocs = 0;
+	for (int i = 0; i < c->n; i++) {
+		document *d = &s->docs[s->ndocs];
+
+		if (doc_read(c->names[i], d) != 0) {
+			fprintf(stderr, "%s: skipped\n", c->names[i]);
+			continue;
+		}
+		doc_normalize(d);
+		s->names[s->ndocs++] = c->names[i];
+	}
+	return s->ndocs;
+}
+
+int
+main(int argc, char **argv)
+{
+	int nthreads = 1; /* threads serving the clients */
+	const char *path = NULL; /* socket to listen on (-u) */
+	struct server s = { 0 };
+	struct sigaction sa = { 0 };
+	sigset_t stop_sigs;
+	corpus docs;
+	int lfd, c;
+
+	corpus_init(&docs);
+
+	while ((c = getopt(argc, argv, "j:l:u:")) != -1) {
+		switch (c)
+		{
+			case 'j':
+				nthreads = atoi(optarg);
+				if (nthreads < 1) nthreads = 1;
+				break;
+			case 'l':
+				if (corpus_add_list(&docs, optarg) != 0) exit(1);
+				break;
+			case 'u':
+				path = optarg;
+				break;
+			default:
+				fprintf(stderr,
+						"Valid options are: -j <threads> -l <doc list file> -u <socket path>\n");
+				exit(1);
+		}
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (corpus_add(&docs, argv[i]) != 0) exit(1);
+	}
+	if (!path || docs.n < 1) {
+		printf("Usage: ./rkserve -u socket_path doc1 [doc2...]\n");
+		exit(1);
+	}
+	if (load_docs(&s, &docs) == 0) exit(1);
+
+	/* -t 1 prints its first hashes, which are no use to anyone here */
+	if (!freopen("/dev/null", "w", stdout)) {
+		perror("freopen ");
+		exit(1);
+	}
+
+	lfd = proto_listen(path);
+	if (lfd < 0) exit(1);
+	/* no SA_RESTART: a signal interrupts accept() */
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	/* the workers inherit the mask, so only this thread is interrupted and
+	   leaves accept() */
+	sigemptyset(&stop_sigs);
+	sigaddset(&stop_sigs, SIGINT);
+	sigaddset(&stop_sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_sigs, NULL);
+
+	/* the workers hash with kernels picked here, the modulus is the default */
+	rk_init();
+	normalize_init();
+	pthread_mutex_init(&s.lock, NULL);
+	pthread_cond_init(&s.nonempty, NULL);
+	pthread_cond_init(&s.nonfull, NULL);
+	for (int i = 0; i < nthreads; i++) {
+		pthread_t t;
+
+		if (pthread_create(&t, NULL, worker, &s) != 0) {
+			perror("pthread_create ");
+			exit(1);
+		}
+		pthread_detach(t);
+	}
+	pthread_sigmask(SIG_UNBLOCK, &stop_sigs, NULL);
+	fprintf(stderr, "rkserve: %d documents, listening on %s\n", s.ndocs, path);
+
+	while (!stopping) {
+		int fd = accept(lfd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno != EINTR && errno != ECONNABORTED) perror("accept ");
+			continue;
+		}
+		pthread_mutex_lock(&s.lock);
+		while (s.len == SERVE_QUEUE) pthread_cond_wait(&s.nonfull, &s.lock);
+		s.queue[(s.head + s.len) % SERVE_QUEUE] = fd;
+		s.len++;
+		pthread_cond_signal(&s.nonempty);
+		pthread_mutex_unlock(&s.lock);
+	}
+
+	/* the threads still serving die with the process */
+	close(lfd);
+	unlink(path);
+	return 0;
+}
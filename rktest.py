@@ -1,6 +1,6 @@
 #!/usr/bin/env python
 
-import subprocess, random, sys, time
+import subprocess, random, sys, time, os, shutil, tempfile
 
 THRES=20
 
@@ -98,6 +98,87 @@ def test_bloom(bsz,seed):
     print "\tbloom test completed" 
  
 
+def test_winnow(ncases,seed):
+	print "   'winnow_test", ncases, seed, "'"
+	p = subprocess.Popen(["./winnow_test", str(ncases), str(seed)],stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+	[s,ss] = p.communicate()
+	r = p.wait()
+	if (r != 0) :
+		print "winnow_test did not pass (returncode=%d)\n" % r, s, ss
+		sys.exit(1)
+	print "\twinnow test completed"
+
+def run_rkmatch(args):
+	p = subprocess.Popen(["./rkmatch"] + args,stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+	[s,ss] = p.communicate()
+	r = p.wait()
+	if (r != 0) :
+		print "'rkmatch", ' '.join(args), "' did not terminate normally (returncode=%d)\n" % r, ss
+		sys.exit(1)
+	return s
+
+def matched_lines(s):
+	return [l for l in s.split('\n') if ' matched: ' in l]
+
+def test_query_list(fsize):
+	xs = get_rand_string(fsize)
+	zs = get_rand_string(fsize)
+	write_to_file(xs,'X')
+	write_to_file(get_denormalized(xs),'X2')
+	write_to_file(zs,'Z')
+	write_to_file(xs[:THRES-1],'X3')
+	ys = get_rand_string(fsize) + xs[fsize//4:fsize//2] + zs[:fsize//8] + xs[:fsize//8]
+	write_to_file(get_denormalized(ys),'Y')
+	# X twice, X2 the same text as X, X3 shorter than k
+	queries = ['X', 'Z', 'X', 'X2', 'X3']
+	write_to_file('\n'.join(queries) + '\n','QL')
+	print "   'rkmatch -t 2 -k ", THRES, " -Q QL Y' queries", ' '.join(queries)
+	for j in [1, 3]:
+		multi = matched_lines(run_rkmatch(["-t", "2", "-k", str(THRES), "-j", str(j), "-Q", "QL", "Y"]))
+		single = [q + ": " + matched_lines(run_rkmatch(["-t", "2", "-k", str(THRES), q, "Y"]))[0] for q in queries]
+		if (multi != single):
+			print "----Per query answer is ----\n", '\n'.join(single), "\n-----Q output is----\n", '\n'.join(multi)
+			sys.exit(1)
+	for f in ['X2', 'X3', 'Z', 'QL']:
+		os.remove(f)
+	print "\t-Q matches every query alone"
+
+def test_index_top(ndocs,seed):
+	random.seed(seed)
+	d = tempfile.mkdtemp()
+	common = get_rand_string(400)
+	xs = common + get_rand_string(4000)
+	write_to_file(xs, os.path.join(d, 'X'))
+	# the fingerprints of common are in most documents, over the
+	# KINDEX_SKIP_DOCS of kindex.c, so their postings have skip tables
+	docs = []
+	for i in range(ndocs):
+		start = (i * 97) % 3000
+		ys = get_rand_string(600) + xs[400+start:400+start+(i%9)*60]
+		if (i % 7 != 0):
+			ys += common
+		ys += get_rand_string(600)
+		docs.append(os.path.join(d, 'D%03d' % i))
+		write_to_file(get_denormalized(ys), docs[-1])
+	idx = os.path.join(d, 'idx')
+	p = subprocess.Popen(["./rkindex", "-k", str(THRES), "-w", "8", "-o", idx] + docs,stdout=subprocess.PIPE,stderr=subprocess.PIPE)
+	[s,ss] = p.communicate()
+	if (p.wait() != 0) :
+		print "rkindex did not terminate normally\n", ss
+		sys.exit(1)
+
+	full = matched_lines(run_rkmatch(["-I", idx, os.path.join(d, 'X')]))
+	# best first, ties in index order
+	ranked = sorted(full, key=lambda l: -int(l.split(' matched: ')[1].split()[0]))
+	for t in [1, 5, 17, ndocs, ndocs + 10]:
+		print "   'rkmatch -I idx -T", t, "X'", ndocs, "documents"
+		top = matched_lines(run_rkmatch(["-I", idx, "-T", str(t), os.path.join(d, 'X')]))
+		if (top != ranked[:t]):
+			print "----Sorted -I output is ----\n", '\n'.join(ranked[:t]), "\n----Your output is----\n", '\n'.join(top)
+			sys.exit(1)
+	shutil.rmtree(d)
+	print "\t-T ranks as the sorted -I output"
+
 def test_near_match(algo,fsize):
 	xs = get_rand_string(fsize)
 	write_to_file(xs,'X')
@@ -176,3 +257,20 @@ if __name__ == '__main__':
 		test_near_miss(2,30000)
 		print "Test RKBATCH passed"
 
+	if (which_test == 4 or which_test == -1):
+		print "Test winnowing against a naive winnower..."
+		for i in range(3):
+			test_winnow(200,i)
+		print "Test winnowing passed"
+
+	if (which_test == 5 or which_test == -1):
+		print "Test query lists (-Q)..."
+		for i in range(3):
+			test_query_list(30000)
+		print "Test query lists passed"
+
+	if (which_test == 6 or which_test == -1):
+		print "Test top documents of an index (-I -T)..."
+		for i in range(3):
+			test_index_top(80,i)
+		print "Test top documents passed"
@@ -0,0 +1,149 @@
+/***********************************************************
+ Implementation of winnowing
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rk.h"
+#include "winnow.h"
+#include "xalloc.h"
+
+/* chunk positions hashed at a time */
+#define WINNOW_BLOCK (1 << 16)
+
+/* Order of the hashes when taking the minimum of a window: the RK hash
+   scrambled by an odd multiplier (a bijection), so that which k-gram is
+   selected does not follow its last characters */
+static inline unsigned long long
+rank(long long h)
+{
+	return (unsigned long long)h * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Select the fingerprints of ts by winnowing (Schleimer, Wilkerson and
+   Aiken, as in MOSS): of every window of w consecutive k-gram hashes the
+   minimum one, the rightmost on ties, is selected, and each selected
+   k-gram is kept once. Any substring of at least w+k-1 characters that
+   two documents share contains a fingerprint of both; about 2/(w+1) of
+   the positions are selected. A document with fewer than w k-grams is a
+   single window.
+   Set *out to the fingerprints in position order (NULL if there are none,
+   to be freed by the caller) and return their number. */
+long long
+winnow_fingerprints(const char *ts, long long n, int k, int w, winnow_fp **out)
+{
+	long long npos = n - k + 1, nfp = 0, cap = 0;
+	long long last = -1;   /* position of the last fingerprint */
+	long long head = 0, len = 0, mask = 1;
+	long long *h;
+	winnow_fp *ring, *fps = NULL;
+
+	*out = NULL;
+	if (npos <= 0) return 0;
+	if (w < 1) w = 1;
+	if (w > npos) w = npos;
+
+	/* ring[head..head+len) (modulo a power of two above w): the positions
+	   of the window that are the minimum of the window from them on, by
+	   increasing position and strictly increasing rank; the first one is
+	   the minimum */
+	while (mask < w) mask = 2 * mask + 1;
+	h = xrealloc(NULL, WINNOW_BLOCK * sizeof(long long));
+	ring = xrealloc(NULL, (mask + 1) * sizeof(winnow_fp));
+
+	for (long long b = 0; b < npos; b += WINNOW_BLOCK) {
+		long long cnt = npos - b < WINNOW_BLOCK ? npos - b : WINNOW_BLOCK;
+
+		rk_hash_positions(k, ts + b, cnt + k - 1, h);
+		for (long long i = 0; i < cnt; i++) {
+			long long pos = b + i;
+
+			while (len > 0 && rank(ring[(head + len - 1) & mask].hash) >= rank(h[i])) len--;
+			ring[(head + len) & mask] = (winnow_fp){ h[i], pos };
+			len++;
+			if (ring[head].pos <= pos - w) {
+				head = (head + 1) & mask;
+				len--;
+			}
+
+			/* the window ending at pos is complete */
+			if (pos >= w - 1 && ring[head].pos != last) {
+				if (nfp == cap) {
+					cap = cap ? 2 * cap : 1024;
+					fps = xrealloc(fps, cap * sizeof(winnow_fp));
+				}
+				fps[nfp++] = ring[head];
+				last = ring[head].pos;
+			}
+		}
+	}
+
+	free(h);
+	free(ring);
+	*out = fps;
+	return nfp;
+}
+
+/* Index the fingerprints of qs. A k-gram selected at several offsets is
+   indexed once, at the first of them. */
+void
+winnow_build(winnow_index *x, const char *qs, long long m, int k, int w)
+{
+	winnow_fp *fp;
+	long long nfp = winnow_fingerprints(qs, m, k, w, &fp);
+
+	x->k = k;
+	x->w = w;
+	x->qs = qs;
+	x->fps = hashtab_init(nfp);
+	for (long long i = 0; i < nfp; i++) {
+		long long s;
+
+		for (s = hashtab_home(&x->fps, fp[i].hash); x->fps.slots[s].key != HASHTAB_EMPTY;
+		     s = (s+1) & x->fps.mask) {
+			if (x->fps.slots[s].key == fp[i].hash && !strncmp(&qs[x->fps.slots[s].val], &qs[fp[i].pos], k)) break;
+		}
+		if (x->fps.slots[s].key == HASHTAB_EMPTY) hashtab_add(&x->fps, fp[i].hash, fp[i].pos);
+	}
+	free(fp);
+}
+
+/* Return the number of the x->fps.n fingerprints of the query that are
+   fingerprints of ts as well. Only the fingerprints of ts are probed, and
+   a probe whose hash is found is confirmed by comparing the k-grams. */
+long long
+winnow_match(const winnow_index *x, const char *ts, long long n)
+{
+	const hashtab *fps = &x->fps;
+	winnow_fp *fp;
+	long long nfp = winnow_fingerprints(ts, n, x->k, x->w, &fp), count = 0;
+	char *found = calloc(fps->mask + 1, 1);
+
+	if (!found) {
+		fprintf(stderr, " failed to allocate %lld bytes. No memory\n", fps->mask + 1);
+		exit(1);
+	}
+
+	for (long long i = 0; i < nfp; i++) {
+		for (long long s = hashtab_home(fps, fp[i].hash); fps->slots[s].key != HASHTAB_EMPTY;
+		     s = (s+1) & fps->mask) {
+			if (fps->slots[s].key == fp[i].hash && !strncmp(&x->qs[fps->slots[s].val], &ts[fp[i].pos], x->k)) {
+				if (!found[s]) count++;
+				found[s] = 1;
+				break;
+			}
+		}
+	}
+
+	free(found);
+	free(fp);
+	return count;
+}
+
+void
+winnow_free(winnow_index *x)
+{
+	hashtab_free(&x->fps);
+}
@@ -0,0 +1,31 @@
+/***********************************************************
+ File Name: winnow.h
+ Description: definition of winnowing, the selection of a
+              small set of RK hashes (fingerprints) of a document
+ **********************************************************/
+#ifndef WINNOW_H
+#define WINNOW_H
+
+#include "hashtab.h"
+
+/* a selected k-gram: its RK hash and its offset in the document */
+typedef struct {
+	long long hash;
+	long long pos;
+} winnow_fp;
+
+/* The fingerprints of the query, the distinct selected k-grams */
+typedef struct {
+	int k;
+	int w;
+	const char *qs;     /* normalized query document */
+	hashtab fps;        /* RK hash -> offset in qs of each fingerprint */
+} winnow_index;
+
+long long winnow_fingerprints(const char *ts, long long n, int k, int w, winnow_fp **out);
+
+void winnow_build(winnow_index *x, const char *qs, long long m, int k, int w);
+long long winnow_match(const winnow_index *x, const char *ts, long long n);
+void winnow_free(winnow_index *x);
+
+#endif
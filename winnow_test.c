@@ -0,0 +1,135 @@
+/***********************************************************
+ File Name: winnow_test.c
+ Description: checks winnow_fingerprints() against a naive
+              winnower on random documents
+ **********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rk.h"
+#include "winnow.h"
+
+static unsigned long long
+naive_rank(long long h)
+{
+	return (unsigned long long)h * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Winnow ts the slow way: hash every k-gram from scratch and scan every
+   window of w hashes for its minimum, the rightmost on ties. Set *out as
+   winnow_fingerprints() does and return the number of fingerprints. */
+static long long
+naive_winnow(const char *ts, long long n, int k, int w, winnow_fp **out)
+{
+	long long npos = n - k + 1, nfp = 0, last = -1;
+	long long *h;
+	winnow_fp *fps;
+
+	*out = NULL;
+	if (npos <= 0) return 0;
+	if (w < 1) w = 1;
+	if (w > npos) w = npos;
+
+	h = malloc(npos * sizeof(long long));
+	fps = malloc(npos * sizeof(winnow_fp));
+	if (!h || !fps) {
+		fprintf(stderr, " failed to allocate %lld positions. No memory\n", npos);
+		exit(1);
+	}
+	for (long long i = 0; i < npos; i++) h[i] = calculate(ts + i, k);
+
+	for (long long e = w - 1; e < npos; e++) {
+		long long min = e - w + 1;
+
+		for (long long i = e - w + 2; i <= e; i++) {
+			if (naive_rank(h[i]) <= naive_rank(h[min])) min = i;
+		}
+		if (min != last) {
+			fps[nfp++] = (winnow_fp){ h[min], min };
+			last = min;
+		}
+	}
+
+	free(h);
+	*out = fps;
+	return nfp;
+}
+
+/* a random normalized document of n characters over the first nletters
+   letters, so that short k-grams repeat */
+static char *
+rand_doc(long long n, int nletters)
+{
+	char *s = malloc(n + 1);
+
+	if (!s) {
+		fprintf(stderr, " failed to allocate %lld bytes. No memory\n", n + 1);
+		exit(1);
+	}
+	for (long long i = 0; i < n; i++) s[i] = 'a' + random() % nletters;
+	s[n] = '\0';
+	return s;
+}
+
+/* Winnow a random document both ways; return 0 if they agree */
+static int
+check(long long n, int nletters, int k, int w)
+{
+	char *ts = rand_doc(n, nletters);
+	winnow_fp *got, *want;
+	long long ngot = winnow_fingerprints(ts, n, k, w, &got);
+	long long nwant = naive_winnow(ts, n, k, w, &want);
+	long long i;
+
+	for (i = 0; i < ngot && i < nwant; i++) {
+		if (got[i].hash != want[i].hash || got[i].pos != want[i].pos) break;
+	}
+	if (i < ngot || i < nwant) {
+		printf("n=%lld letters=%d k=%d w=%d: fingerprint %lld is ", n, nletters, k, w, i);
+		if (i < ngot) printf("(%lld at %lld)", got[i].hash, got[i].pos);
+		else printf("missing");
+		printf(", should be ");
+		if (i < nwant) printf("(%lld at %lld)\n", want[i].hash, want[i].pos);
+		else printf("missing\n");
+	}
+
+	free(ts);
+	free(got);
+	free(want);
+	return i < ngot || i < nwant;
+}
+
+int
+main(int argc, char **argv)
+{
+	int ncases, failed = 0;
+
+	if (argc < 2) {
+		printf("Usage:\n ./winnow_test <number_of_cases> [random_num_seed]\n");
+		exit(1);
+	}
+	ncases = atoi(argv[1]);
+	if (argc > 2) {
+		srandom(atoi(argv[2]));
+	}
+
+	rk_init();
+	for (int c = 0; c < ncases && !failed; c++) {
+		long long n = random() % 3000;
+		int k = 1 + random() % 12, w = 1 + random() % 40;
+
+		/* a few documents longer than one block of hashed positions, and
+		   windows longer than the document */
+		if (c % 16 == 0) n = 65536 + random() % 4096;
+		if (c % 8 == 1) w = n + random() % 8;
+		failed = check(n, 1 + random() % 26, k, w);
+	}
+	/* windows of hashes that are all equal */
+	if (!failed) failed = check(1000, 1, 5, 7);
+
+	if (failed) return 1;
+	printf("winnow test passed\n");
+	return 0;
+}
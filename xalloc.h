@@ -0,0 +1,22 @@
+/***********************************************************
+ File Name: xalloc.h
+ Description: allocation that exits when there is no memory
+ **********************************************************/
+#ifndef XALLOC_H
+#define XALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline void *
+xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		fprintf(stderr, " failed to allocate %zu bytes. No memory\n", size);
+		exit(1);
+	}
+	return p;
+}
+
+#endif